@@ -4,6 +4,8 @@
 // definitions of static vector-members for Pool templated-classes
 template <typename T>
 std::vector<T *> Pool<T>::_pool;
+template <typename T>
+pthread_mutex_t Pool<T>::_lock = PTHREAD_MUTEX_INITIALIZER;
 
 // defns for static PathFactory members
 uint8_t PathFactory::_flags = 0;
@@ -12,6 +14,41 @@ pid_t PathFactory::_pid = 0; // for PLFS
 int PathFactory::_rank = 1;
 int PathFactory::_n_ranks = 1;
 
+// generic version: build a Path from the full path-name, and stat that
+bool
+Path::stat_entry(const char *name, path_item *item)
+{
+   PathPtr p(PathFactory::create(item->path));
+   if (!p->exists())
+      return false;
+   *item = p->node();
+   return true;
+}
+
+// generic version: copy names out of readdir(), one at a time, until <buf>
+// might not hold another one
+bool
+Path::readdir_batch(std::vector<DirEntry> &entries, char *buf, size_t size)
+{
+   size_t used = 0;
+
+   entries.clear();
+   while (size - used > NAME_MAX)
+   {
+      if (!readdir(buf + used, size - used))
+         return false;
+      if (!buf[used])
+         break; // EOF
+      DirEntry entry;
+      entry.name = buf + used;
+      entry.ino = 0;
+      entry.type = DT_UNKNOWN;
+      entries.push_back(entry);
+      used += strlen(buf + used) + 1;
+   }
+   return true;
+}
+
 // NOTE: New path might not be of the same subclass as us.  For example, we
 //    could be descending into a PLFS volume.
 //
@@ -75,8 +75,11 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <dirent.h> // POSIX directories
+#include <unistd.h>
+#include <sys/syscall.h> // SYS_getdents64
 
 #include <cxxabi.h> // name-demangling
+#include <pthread.h> // Pool<T>
 // #include <typeinfo>             // typeid()
 
 #include <iostream>
@@ -181,17 +184,25 @@ public:
       //      std::cout << "Pool<T>::put(" << t << ")" << std::endl;
       // t->~T();                  // explicit destructor-call to do clean-up
       *t = T(); // reset via operator=()
+      pthread_mutex_lock(&_lock);
       _pool.push_back(t);
+      pthread_mutex_unlock(&_lock);
    }
 
    // if the pool is not empty, extract an item, otherwise create one
    static SharedPtr<T> get()
    {
       //      std::cout << "Pool<T>::get() -- pool size = " << _pool.size() << std::endl;
+      T *t = NULL;
+      pthread_mutex_lock(&_lock);
       if (_pool.size())
       {
-         T *t = _pool.back();
+         t = _pool.back();
          _pool.pop_back();
+      }
+      pthread_mutex_unlock(&_lock);
+      if (t)
+      {
          //         std::cout << "Pool<T>::get() -- "
          //                   << "old = " << t << std::endl;
          return SharedPtr<T>(t, put); // use put(), as shared_ptr deleter-fn
@@ -207,6 +218,7 @@ public:
 protected:
    // per-class vectors hold the pool objects
    static std::vector<T *> _pool;
+   static pthread_mutex_t _lock; // for worker threads (see run_worker_threads())
 };
 
 // ---------------------------------------------------------------------------
@@ -287,6 +299,13 @@ protected:
 #define NO_IMPL(METHOD) unimplemented(__FILE__, __LINE__, (#METHOD))
 #define NO_IMPL_STATIC(METHOD, CLASS) unimplemented_static(__FILE__, __LINE__, (#METHOD), (#CLASS))
 
+// one entry from Path::readdir_batch()
+struct DirEntry
+{
+   const char *name;   // points into the caller's buffer
+   ino_t ino;          // 0, if not known
+   unsigned char type; // DT_*, or DT_UNKNOWN
+};
 
 class Path
 {
@@ -802,6 +821,17 @@ public:
    virtual bool readdir(char *path, size_t size) = 0;
    virtual bool mkdir(mode_t mode) = 0;
 
+   // Read the next batch of entries into <entries>, using <buf> (of <size>
+   // bytes) to hold the names.  The names stay valid until the next call.
+   // Returns false only for errors; at EOF, <entries> comes back empty.
+   // The default just calls readdir() until <buf> is full.
+   virtual bool readdir_batch(std::vector<DirEntry> &entries, char *buf, size_t size);
+
+   // stat the entry <name> of this (open) directory, whose full path is
+   // already in <item>->path.  Subclasses that can stat relative to the
+   // open directory skip the path lookup.  Returns false if stat fails.
+   virtual bool stat_entry(const char *name, path_item *item);
+
    // delete the file/object
    virtual bool remove() = 0;
    virtual bool unlink() = 0;
@@ -1152,6 +1182,63 @@ public:
       return true;
    }
 
+#ifdef SYS_getdents64
+   // getdents64() straight into the caller's buffer: one system call per
+   // buffer-full of entries, rather than going through readdir().
+   virtual bool readdir_batch(std::vector<DirEntry> &entries, char *buf, size_t size)
+   {
+      struct linux_dirent64
+      {
+         uint64_t d_ino;
+         int64_t d_off;
+         unsigned short d_reclen;
+         unsigned char d_type;
+         char d_name[1];
+      };
+
+      entries.clear();
+      unset(DID_STAT); // instead of updating _item->st, just mark it out-of-date
+      long bytes = syscall(SYS_getdents64, dirfd(_dirp), buf, size);
+      if (bytes < 0)
+      {
+         _errno = errno;
+         return false;
+      }
+      for (long off = 0; off < bytes;)
+      {
+         struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + off);
+         DirEntry entry;
+         entry.name = d->d_name;
+         entry.ino = d->d_ino;
+         entry.type = d->d_type;
+#if defined(MARFS) || defined(GEN_SYNDATA)
+         // a sub-directory might not be POSIX (see stat_entry())
+         if (entry.type == DT_DIR)
+            entry.type = DT_UNKNOWN;
+#endif
+         entries.push_back(entry);
+         off += d->d_reclen;
+      }
+      return true;
+   }
+#endif
+
+   // fstatat() on the open directory, instead of walking the whole path
+   // again.  stat_item() has to see the full path when it might be below
+   // a MarFS mount, or a synthetic-data path.
+   virtual bool stat_entry(const char *name, path_item *item)
+   {
+#if defined(MARFS) || defined(GEN_SYNDATA)
+      return Path::stat_entry(name, item);
+#else
+      if (fstatat(dirfd(_dirp), name, &item->st, AT_SYMLINK_NOFOLLOW))
+         return false;
+      item->ftype = REGULARFILE;
+      item->dest_ftype = REGULARFILE;
+      return true;
+#endif
+   }
+
    virtual ssize_t write(char *buf, size_t count, off_t offset)
    {
       ssize_t bytes = pwrite(_fd, buf, count, offset);
@@ -2273,10 +2360,10 @@ public:
    }
 #else
    // avoid copying from unpacked path_item into constructed Path's path_item.
-   static PathPtr unpack(char *buff, size_t size, int position, MPI_Comm comm = MPI_COMM_WORLD)
+   static PathPtr unpack(const path_batch_view *view, int index)
    {
       PathItemPtr work_node_ptr(Pool<path_item>::get());
-      MPI_Unpack(buff, size, &position, work_node_ptr.get(), sizeof(path_item), MPI_CHAR, comm);
+      unpack_path_item(work_node_ptr.get(), view, index);
       return create(work_node_ptr);
    }
 #endif
@@ -26,6 +26,9 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <limits.h>
+#include <dirent.h>
+
 #include <sys/param.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -267,6 +270,116 @@ char *genCTFFilename(const char *transfilename) {
 	return(strdup(tmpname));
 }
 
+// Index of the names in the CTF directory, taken once at startup by
+// indexCTFDir(), so that files with no CTF file (nearly all of them) skip
+// the digests and the open() that would fail with ENOENT.  Names are kept
+// as FNV-1a hashes; a collision just means we go and look, as before.
+static uint64_t *CTFIndex = (uint64_t *)NULL;	// sorted
+static size_t CTFIndexCount = 0;
+static int CTFIndexed = FALSE;				// CTFIndex is in use
+
+static uint64_t _hashCTFName(const char *name) {
+	uint64_t hash = 14695981039346656037ULL;	// FNV-1a
+
+	for(; *name; name++)
+	  hash = (hash ^ (unsigned char)*name) * 1099511628211ULL;
+	return(hash);
+}
+
+static int _compareCTFHash(const void *a, const void *b) {
+	uint64_t ha = *(const uint64_t *)a;
+	uint64_t hb = *(const uint64_t *)b;
+
+	return((ha < hb) ? -1 : (ha > hb));
+}
+
+/**
+* Collective. The manager reads the CTF directory, and broadcasts
+* the index to all ranks. If the directory can't be read (or the
+* index is too big to broadcast), there is no index, and every file
+* is looked up as before.
+*
+* Note that CTF files created after this, by some other job, will
+* not be seen by mayHaveCTF().
+*
+* @param rank	the MPI rank of the caller
+*/
+void indexCTFDir(int rank) {
+	unsigned long long count = 0;
+	int indexed = FALSE;
+
+	if(rank == MANAGER_PROC) {
+	  char *ctfdir = _getCTFDir();
+	  DIR *dirp = (ctfdir ? opendir(ctfdir) : (DIR *)NULL);
+	  size_t alloc = 0;
+	  struct dirent *d;
+
+	  indexed = (dirp != NULL);
+	  while(indexed && (d = readdir(dirp))) {
+	    if(d->d_name[0] == '.')			// CTF names are hex digests
+	      continue;
+	    if(count == alloc) {
+	      alloc = (alloc ? (alloc * 2) : 1024);
+	      uint64_t *grown = (uint64_t *)realloc(CTFIndex, alloc * sizeof(uint64_t));
+	      if(!grown) {
+	        indexed = FALSE;
+	        break;
+	      }
+	      CTFIndex = grown;
+	    }
+	    CTFIndex[count++] = _hashCTFName(d->d_name);
+	  }
+	  if(dirp)
+	    closedir(dirp);
+	  if(count * sizeof(uint64_t) > INT_MAX)
+	    indexed = FALSE;
+	  if(!indexed)
+	    count = 0;
+	  qsort(CTFIndex, count, sizeof(uint64_t), _compareCTFHash);
+	}
+
+	MPI_Bcast(&indexed, 1, MPI_INT, MANAGER_PROC, MPI_COMM_WORLD);
+	MPI_Bcast(&count, 1, MPI_UNSIGNED_LONG_LONG, MANAGER_PROC, MPI_COMM_WORLD);
+	if(rank != MANAGER_PROC && count) {
+	  CTFIndex = (uint64_t *)malloc(count * sizeof(uint64_t));
+	  if(!CTFIndex) {
+	    fprintf(stderr, "Failed to allocate %llu bytes for the CTF index\n", count * sizeof(uint64_t));
+	    MPI_Abort(MPI_COMM_WORLD, -1);
+	  }
+	}
+	if(count)
+	  MPI_Bcast(CTFIndex, (int)(count * sizeof(uint64_t)), MPI_BYTE, MANAGER_PROC, MPI_COMM_WORLD);
+
+	CTFIndexCount = count;
+	CTFIndexed = indexed;
+}
+
+/**
+* Function to indicate whether the CTF file associated with a
+* file might exist, according to the index taken by indexCTFDir().
+* Without an index, the answer is always TRUE.
+*
+* @param transfilename	the name of the file to transfer
+*
+* @return FALSE if there is certainly no CTF file. Otherwise TRUE.
+*/
+int mayHaveCTF(const char *transfilename) {
+	uint64_t hash;
+	char *md5fname;					// MD5 version of transfer file
+
+	if(!CTFIndexed)
+	  return(TRUE);
+	if(!CTFIndexCount || strIsBlank(transfilename))	// the usual case: no CTF files at all
+	  return(FALSE);
+
+	if(!(md5fname = str2sig(transfilename)))
+	  return(TRUE);
+	hash = _hashCTFName(md5fname);
+	free(md5fname);
+
+	return(bsearch(&hash, CTFIndex, CTFIndexCount, sizeof(uint64_t), _compareCTFHash) != NULL);
+}
+
 /**
 * Function to indicate if the CTF file associated with
 * a file actually exists in the filesystem.
@@ -280,7 +393,7 @@ int foundCTF(const char *transfilename) {
 	char *ctffname;					// the CTF file path
 
 	// Build CTF file name. If no name generated -> no file
-	if(!(ctffname=genCTFFilename(transfilename)))
+	if(!mayHaveCTF(transfilename) || !(ctffname=genCTFFilename(transfilename)))
 	  return(FALSE);
 
 	int stat_rc = stat(ctffname,&sbuf);
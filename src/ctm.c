@@ -287,6 +287,19 @@ int hasCTM(const char *transfilename) {
 	}
 }
 
+/**
+* Collective. Takes an index of the persistent CTM store, so that
+* hasCTM() and check_ctm_match() can skip files that certainly
+* have no CTM. Only the CTF store can be indexed.
+*
+* @param rank	the MPI rank of the caller
+*/
+void indexCTM(int rank) {
+#ifdef RESTART
+	indexCTFDir(rank);
+#endif
+}
+
 /**
 * Function to purge CTM data from a given file.
 *
@@ -448,6 +461,9 @@ int check_ctm_match(const char* src_to_hash, const char* dest)
 	char* src_hash; //must be freed
 	char ctm_src_hash[SIG_DIGEST_LENGTH * 2 + 1] = {0};
 
+	if(!mayHaveCTF(dest))
+		return 0; // not in the index taken at startup (see indexCTFDir())
+
 	ctm_name = genCTFFilename(dest);
 	src_hash = str2sig(src_to_hash);
 
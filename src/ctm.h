@@ -94,6 +94,7 @@ CTM *getCTM(const char *transfilename, long numchunks, size_t chunksize);
 int updateCTM(CTM *ctmptr, long chnkidx);
 int removeCTM(CTM **pctmptr);
 int hasCTM(const char *transfilename);
+void indexCTM(int rank);
 void purgeCTM(const char *transfilename);
 size_t allocateCTMFlags(CTM *ctmptr);
 
@@ -23,6 +23,8 @@
 // CTF (Chunk Transfer File) Function Declarations
 char *genCTFFilename(const char *transfilename);
 int foundCTF(const char *transfilename);
+int mayHaveCTF(const char *transfilename);
+void indexCTFDir(int rank);
 void registerCTF(CTM_IMPL *ctmimplptr);
 int unlinkCTF(const char *chnkfname);
 
@@ -31,6 +31,7 @@
 #include "Path.h"
 
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 #include <algorithm>
@@ -73,6 +74,9 @@ int main(int argc, char *argv[])
     //mpi
     int rank = 0;
     int nproc = 0;
+    int *managers = NULL; // who feeds each rank (see assign_sub_managers())
+    int *nodes = NULL;    // node each rank is on (see assign_nodes())
+    int thread_level = MPI_THREAD_SINGLE;
 
     //getopt
     int c;
@@ -125,7 +129,8 @@ int main(int argc, char *argv[])
 
 #endif //  MARFS
 
-    if (MPI_Init(&argc, &argv) != MPI_SUCCESS)
+    // '-y' worker threads never call MPI themselves (see run_worker_threads())
+    if (MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &thread_level) != MPI_SUCCESS)
     {
         fprintf(stderr, "Error in MPI_Init\n");
         return -1;
@@ -182,6 +187,19 @@ int main(int argc, char *argv[])
         o.chunksize = (10ULL * 1024 * 1024 * 1024);
         o.exclude[0] = '\0';
         o.max_readdir_ranks = MAXREADDIRRANKS;
+        o.wait_mode = WAIT_BACKOFF;
+        o.work_stealing = 0;
+        o.sub_managers = 0;
+        o.spill_mem = WORK_SPILL_MEM_DEFAULT;
+        o.dispatch = DISPATCH_DEFAULT;
+        o.dispatch_low = DISPATCH_RATIO_LOW;
+        o.dispatch_high = DISPATCH_RATIO_HIGH;
+        o.placement = PLACE_ANY;
+        o.worker_threads = 1;
+        o.dest_listing = 0;
+        strncpy(o.spill_dir, (getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp"), PATHSIZE_PLUS - 1);
+        o.log_dir[0] = '\0';
+        o.snapshot_dir[0] = '\0';
         src_path[0] = '\0';
         dest_path[0] = '\0';
 
@@ -198,7 +216,7 @@ int main(int argc, char *argv[])
 #endif
 
         // start MPI - if this fails we cant send the error to thtooloutput proc so we just die now
-        while ((c = getopt(argc, argv, "p:c:j:w:i:s:C:S:a:f:d:A:t:X:x:z:e:M:nhvgWRDorlP")) != -1)
+        while ((c = getopt(argc, argv, "p:c:j:w:i:s:C:S:a:f:d:A:t:X:x:z:e:M:Q:L:I:m:T:q:N:y:nhvgkHWRDorlPB")) != -1)
         {
             switch (c)
             {
@@ -262,6 +280,17 @@ int main(int argc, char *argv[])
                 o.max_readdir_ranks = atoi(optarg);
                 break;
 
+            case 'Q':
+                // this is <WaitMode>, from pfutils.h
+                // 0 = spin, 1 = backoff, 2 = block
+                o.wait_mode = atoi(optarg);
+                if ((o.wait_mode < WAIT_SPIN) || (o.wait_mode > WAIT_BLOCK))
+                {
+                    fprintf(stderr, "Invalid wait mode '%s'\n", optarg);
+                    return -1;
+                }
+                break;
+
             case 'X':
 #ifdef GEN_SYNDATA
                 strncpy(o.syn_pattern, optarg, 128);
@@ -349,6 +378,75 @@ int main(int argc, char *argv[])
                 o.exclude[PATHSIZE_PLUS - 1] = '\0';
                 break;
 
+            case 'L':
+                strncpy(o.log_dir, optarg, PATHSIZE_PLUS);
+                if (o.log_dir[PATHSIZE_PLUS - 1])
+                {
+                    fprintf(stderr, "Oversize path for log directory '%s'\n", optarg);
+                    MPI_Abort(MPI_COMM_WORLD, -1);
+                }
+                break;
+
+            case 'I':
+                strncpy(o.snapshot_dir, optarg, PATHSIZE_PLUS);
+                if (o.snapshot_dir[PATHSIZE_PLUS - 1])
+                {
+                    fprintf(stderr, "Oversize path for snapshot directory '%s'\n", optarg);
+                    MPI_Abort(MPI_COMM_WORLD, -1);
+                }
+                break;
+
+            case 'k':
+                o.work_stealing = 1;
+                break;
+
+            case 'B':
+                o.dest_listing = 1;
+                break;
+
+            case 'H':
+                o.sub_managers = 1;
+                break;
+
+            case 'm':
+                o.spill_mem = str2Size(optarg);
+                break;
+
+            case 'q':
+                if (parse_dispatch_policy(optarg, &o.dispatch, &o.dispatch_low, &o.dispatch_high))
+                {
+                    fprintf(stderr, "Unknown dispatch policy '%s'\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'N':
+                o.placement = parse_placement(optarg);
+                if (o.placement < 0)
+                {
+                    fprintf(stderr, "Unknown chunk placement '%s'\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'y':
+                o.worker_threads = atoi(optarg);
+                if ((o.worker_threads < 1) || (o.worker_threads > WORKER_THREADS_MAX))
+                {
+                    fprintf(stderr, "'-y' must be between 1 and %d\n", WORKER_THREADS_MAX);
+                    return -1;
+                }
+                break;
+
+            case 'T':
+                strncpy(o.spill_dir, optarg, PATHSIZE_PLUS);
+                if (o.spill_dir[PATHSIZE_PLUS - 1])
+                {
+                    fprintf(stderr, "Oversize path for scratch directory '%s'\n", optarg);
+                    MPI_Abort(MPI_COMM_WORLD, -1);
+                }
+                break;
+
             case 'W':
 		o.direct_write = 1; // use direct IO / O_DIRECT
 		break;
@@ -383,6 +481,31 @@ int main(int argc, char *argv[])
             fprintf(stderr, "'-n' can't be used with '-w 2'\n");
             return -1;
         }
+        if (o.dest_listing && (o.work_type == LSWORK))
+        {
+            fprintf(stderr, "'-B' needs a destination\n");
+            return -1;
+        }
+        if (o.snapshot_dir[0] && ((o.work_type != COPYWORK) || !o.different))
+        {
+            fprintf(stderr, "'-I' can only be used with '-w 0 -n'\n");
+            return -1;
+        }
+        if (strlen(o.spill_dir) + 1 + strlen(WORK_SPILL_TEMPLATE) >= PATHSIZE_PLUS)
+        {
+            fprintf(stderr, "Scratch directory name too long '%s'\n", o.spill_dir);
+            return -1;
+        }
+        if (o.work_stealing && o.sub_managers)
+        {
+            fprintf(stderr, "'-H' can't be used with '-k'\n");
+            return -1;
+        }
+        if ((o.worker_threads > 1) && (thread_level < MPI_THREAD_FUNNELED))
+        {
+            fprintf(stderr, "MPI doesn't support threads, ignoring '-y %d'\n", o.worker_threads);
+            o.worker_threads = 1;
+        }
         if ( geteuid() == 0 )
         {
             o.preserve = 2; // default to 'preserve' + ownership checks for root, always
@@ -454,8 +577,15 @@ int main(int argc, char *argv[])
     MPI_Bcast(&o.chunksize, 1, MPI_DOUBLE, MANAGER_PROC, MPI_COMM_WORLD);
     MPI_Bcast(&o.preserve, 1, MPI_INT, MANAGER_PROC, MPI_COMM_WORLD);
     MPI_Bcast(&o.use_file_list, 1, MPI_INT, MANAGER_PROC, MPI_COMM_WORLD);
+    MPI_Bcast(&o.wait_mode, 1, MPI_INT, MANAGER_PROC, MPI_COMM_WORLD);
+    MPI_Bcast(&o.work_stealing, 1, MPI_INT, MANAGER_PROC, MPI_COMM_WORLD);
+    MPI_Bcast(&o.sub_managers, 1, MPI_INT, MANAGER_PROC, MPI_COMM_WORLD);
+    MPI_Bcast(&o.worker_threads, 1, MPI_INT, MANAGER_PROC, MPI_COMM_WORLD);
+    MPI_Bcast(&o.dest_listing, 1, MPI_INT, MANAGER_PROC, MPI_COMM_WORLD);
     MPI_Bcast(o.jid, 128, MPI_CHAR, MANAGER_PROC, MPI_COMM_WORLD);
     MPI_Bcast(o.exclude, PATHSIZE_PLUS, MPI_CHAR, MANAGER_PROC, MPI_COMM_WORLD);
+    MPI_Bcast(o.log_dir, PATHSIZE_PLUS, MPI_CHAR, MANAGER_PROC, MPI_COMM_WORLD);
+    MPI_Bcast(o.snapshot_dir, PATHSIZE_PLUS, MPI_CHAR, MANAGER_PROC, MPI_COMM_WORLD);
 
 #ifdef GEN_SYNDATA
     MPI_Bcast(o.syn_pattern, 128, MPI_CHAR, MANAGER_PROC, MPI_COMM_WORLD);
@@ -472,6 +602,32 @@ int main(int argc, char *argv[])
         openlog(sysmsg, (LOG_PID | LOG_CONS), LOG_USER);
     }
 
+    // with '-L', workers write their own output, and OUTPUT_PROC only
+    // handles the manager's header/progress/footer (and errors)
+    if (o.log_dir[0] && (rank != MANAGER_PROC) && (rank != OUTPUT_PROC))
+    {
+        open_output_shard(o.log_dir, o.jid, rank);
+    }
+
+    // with '-H', workers report to the sub-manager on their node
+    managers = (int *)malloc(nproc * sizeof(int));
+    nodes = (int *)malloc(nproc * sizeof(int));
+    if (!managers || !nodes)
+    {
+        fprintf(stderr, "Failed to allocate %lu bytes for managers\n", nproc * sizeof(int));
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    for (i = 0; i < nproc; i++)
+    {
+        managers[i] = MANAGER_PROC;
+    }
+    assign_nodes(nodes, rank, nproc);
+    if (o.sub_managers)
+    {
+        assign_sub_managers(managers, nodes, nproc);
+    }
+    set_manager_rank(managers[rank]);
+
     // Path factory might want to use some of these fields.
     // TBD: Maybe we also want the src files processed via enqueue_path(), below.
     //
@@ -642,16 +798,25 @@ int main(int argc, char *argv[])
     // take on the role appropriate to our rank.
     if (run)
     {
+        indexCTM(rank);
+        if (o.snapshot_dir[0])
+        {
+            load_snapshot_index(o.snapshot_dir, rank);
+        }
         if (rank == MANAGER_PROC)
         {
-            ret_val = manager(rank, o, nproc, input_queue_head, input_queue_tail, input_queue_count, dest_path);
+            ret_val = manager(rank, o, nproc, input_queue_head, input_queue_tail, input_queue_count, dest_path, managers, nodes);
         }
         else
         {
-            worker(rank, o);
+            worker(rank, o, managers, nodes);
         }
     }
 
+    free(managers);
+    free(nodes);
+    drain_sends();
+    close_output_shard();
     MPI_Finalize();
     return ret_val;
 }
@@ -691,20 +856,23 @@ int manager(int rank,
             path_list *input_queue_head,
             path_list *input_queue_tail,
             int input_queue_count,
-            const char *dest_path)
+            const char *dest_path,
+            const int *managers,
+            const int *nodes)
 {
 
     MPI_Status status;
     int message_ready = 0;
     int probecount = 0;
-    int prc;
+    wait_state waiter;
     int type_cmd;
-    int work_rank;
+    char *msg;
     int sending_rank;
     int i;
-    struct worker_proc_status *proc_status;
-    int readdir_rank_count = 0;
-    int free_worker_count = 0; // only counts ranks >= START_PROC
+    worker_pool workers;
+    int seed_rank = START_PROC; // next rank to get a source, with work-stealing
+    dispatch_policy policy;
+    dispatch_plan plan;
 
     struct timeval in;
     struct timeval out;
@@ -730,8 +898,15 @@ int manager(int rank,
     size_t num_copied_bytes = 0;
     size_t num_copied_bytes_prev = 0; // captured at previous timer
 
+    // copy/compare work waits in <process_heap>, largest first, and moves
+    // to <process_buf_list> as it's handed out.  Chunks waiting for their
+    // home node ('-N local') wait in <process_parked>.  <process_buf_list_size>
+    // counts all three.
+    work_buf_heap process_heap = {0};
     work_buf_list *process_buf_list = NULL;
     work_buf_list *process_buf_list_tail = NULL;
+    work_buf_list *process_parked = NULL;
+    work_buf_list *process_parked_tail = NULL;
     int process_buf_list_size = 0;
 
     work_buf_list *dir_buf_list = NULL;
@@ -938,21 +1113,20 @@ int manager(int rank,
         }
     }
 
-    //pack our list into a buffer:
-    pack_list(input_queue_head, input_queue_count, &dir_buf_list, &dir_buf_list_tail, &dir_buf_list_size);
-    delete_queue_path(&input_queue_head, &input_queue_count);
-
-    //allocate a vector to hold proc status for every proc
-    const size_t proc_status_size = (nproc * sizeof(struct worker_proc_status));
-    proc_status = (struct worker_proc_status *)malloc(proc_status_size);
-    if (!proc_status)
+    // queued work beyond o.spill_mem goes to a scratch file
+    if (o.spill_mem)
     {
-        fprintf(stderr, "manager; couldn't allocate %ld bytes for proc_status\n", proc_status_size);
-        MPI_Abort(MPI_COMM_WORLD, -1);
+        init_work_spill(o.spill_dir, o.spill_mem);
     }
-    memset(proc_status, 0, proc_status_size);
 
-    free_worker_count = nproc - START_PROC;
+    //allocate a vector to hold proc status for every proc
+    init_worker_pool(&workers, nproc, managers, nodes, MANAGER_PROC);
+
+    //pack our list into buffers, spread over all the ranks to start with
+    pack_list(input_queue_head, input_queue_count, (input_queue_count + workers.nslots - 1) / workers.nslots,
+              &dir_buf_list, &dir_buf_list_tail, &dir_buf_list_size);
+    delete_queue_path(&input_queue_head, &input_queue_count);
+    init_dispatch_policy(&policy, &workers, o.dispatch, o.dispatch_low, o.dispatch_high);
 
     sprintf(message, "INFO  HEADER   ========================  %s  ============================\n", o.jid);
     write_output(message, 1);
@@ -968,6 +1142,49 @@ int manager(int rank,
         sprintf(message, "INFO  HEADER   Dest-type:   %s\n", p_dest->class_name().get());
         write_output(message, 1);
 
+        if (o.log_dir[0])
+        {
+            snprintf(message, MESSAGESIZE, "INFO  HEADER   Worker logs: '%s'\n", o.log_dir);
+            write_output(message, 1);
+        }
+
+        if (o.snapshot_dir[0])
+        {
+            snprintf(message, MESSAGESIZE, "INFO  HEADER   Snapshot:    '%s'\n", o.snapshot_dir);
+            write_output(message, 1);
+        }
+
+        if (o.dispatch == DISPATCH_RATIO)
+        {
+            sprintf(message, "INFO  HEADER   Dispatch:    ratio (%d..%d queued)\n", o.dispatch_low, o.dispatch_high);
+            write_output(message, 1);
+        }
+        else if (o.dispatch != DISPATCH_DEFAULT)
+        {
+            sprintf(message, "INFO  HEADER   Dispatch:    %s\n", dispatch_policy_name(o.dispatch));
+            write_output(message, 1);
+        }
+
+        if (o.placement != PLACE_ANY)
+        {
+            sprintf(message, "INFO  HEADER   Placement:   %s\n", placement_name(o.placement));
+            write_output(message, 1);
+        }
+
+        if (o.sub_managers)
+        {
+            int sub_count = 0;
+            for (i = START_PROC; i < nproc; i++)
+            {
+                if (sub_manager_workers(managers, nproc, i))
+                {
+                    sub_count++;
+                }
+            }
+            sprintf(message, "INFO  HEADER   Sub-managers: %d\n", sub_count);
+            write_output(message, 1);
+        }
+
 #ifdef CONDUIT
         // possibly send Conduit Header message
         snprintf( message, MESSAGESIZE,
@@ -979,6 +1196,7 @@ int manager(int rank,
 
     //starttime
     gettimeofday(&in, NULL);
+    wait_init(&waiter, o.wait_mode);
 
     // process responses from workers
     while (1)
@@ -987,16 +1205,15 @@ int manager(int rank,
         while (message_ready == 0)
         {
 
-            // check for availability of message (without reading it)
-            prc = MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD,
-                             &message_ready, &status);
-            if (prc != MPI_SUCCESS)
-            {
-                errsend(FATAL, "MPI_Iprobe failed\n");
-                message_ready = -1;
-            }
-            else
-                probecount++;
+            // check for availability of message (without reading it).
+            // Only block if there's nothing to hand out, but someone is
+            // still working (so a message will come), and we don't need to
+            // wake up for the periodic output.
+            int can_block = (o.verbose &&
+                             !(workers.free_count && (process_buf_list_size || dir_buf_list_size)) &&
+                             !processing_complete(&workers));
+            message_ready = wait_for_message(&waiter, can_block, &status);
+            probecount++;
 
             if (probecount % 3000 == 0)
             {
@@ -1023,76 +1240,41 @@ int manager(int rank,
             // Always try to dish out work, before handling messages
             // Otherwise, we can be preoccupied with CHNKCMD msgs, for a big copy
             // NOTE: We're assuming the #ifdef TAPE is obsolete
-            if (free_worker_count && process_buf_list_size)
+            //
+            // With work-stealing, workers share out the work among
+            // themselves.  We just hand out the initial sources, round-robin,
+            // and count buffers until they're all done.
+            if (o.work_stealing)
             {
-                for (i = 0; i < nproc; i++)
-                {
-                    PRINT_PROC_DEBUG("Rank %d, Status %d\n", i, proc_status.inuse[i]);
-                }
-                PRINT_PROC_DEBUG("=============\n");
-                if (o.work_type == COPYWORK)
+                while (dir_buf_list_size)
                 {
-                    for (i = 0; i < 3; i++)
-                    {
-                        work_rank = get_free_rank(proc_status, START_PROC, nproc - 1);
-                        if (work_rank >= 0 && process_buf_list_size > 0)
-                        {
-                            proc_status[work_rank].inuse = 1;
-                            free_worker_count -= 1;
-                            send_worker_copy_path(work_rank, &process_buf_list, &process_buf_list_tail, &process_buf_list_size);
-                        }
-                        else
-                            break;
-                    }
-                }
-                else if (o.work_type == COMPAREWORK)
-                {
-                    for (i = 0; i < 3; i++)
-                    {
-                        work_rank = get_free_rank(proc_status, START_PROC, nproc - 1);
-                        if (work_rank >= 0 && process_buf_list_size > 0)
-                        {
-                            proc_status[work_rank].inuse = 1;
-                            free_worker_count -= 1;
-                            send_worker_compare_path(work_rank, &process_buf_list, &process_buf_list_tail, &process_buf_list_size);
-                        }
-                        else
-                            break;
-                    }
-                }
-                else
-                {
-                    //delete the queue here
-                    delete_buf_list(&process_buf_list, &process_buf_list_tail, &process_buf_list_size);
+                    workers.pending_bufs += 1;
+                    send_worker_readdir(seed_rank, &dir_buf_list, &dir_buf_list_tail, &dir_buf_list_size);
+                    seed_rank = (seed_rank + 1 < nproc) ? (seed_rank + 1) : START_PROC;
                 }
+                start = 0;
             }
 
-            // stop handing out new readdir/stat work if we're over readdir_rank max
-            if (dir_buf_list_size && ((-1 == o.max_readdir_ranks) || (readdir_rank_count < o.max_readdir_ranks)))
+            // Otherwise, the dispatch policy ('-q') decides how much of
+            // each kind of work to hand out, and which goes first.
+            else
             {
-                work_rank = get_free_rank(proc_status, START_PROC, nproc - 1);
-                if (work_rank >= 0)
+                update_batch_level(&workers, process_buf_list_size + dir_buf_list_size);
+                plan_dispatch(&policy, &workers, process_buf_list_size, dir_buf_list_size, o.max_readdir_ranks, &plan);
+                if (plan.readdir_first)
                 {
-                    if (((start == 1 || o.recurse) && dir_buf_list_size))
-                    {
-                        proc_status[work_rank].inuse = 1;
-                        free_worker_count -= 1;
-                        proc_status[work_rank].readdir = 1;
-                        readdir_rank_count += 1;
-                        send_worker_readdir(work_rank, &dir_buf_list, &dir_buf_list_tail, &dir_buf_list_size);
-                        // GRANSOM EDIT:
-                        //   Changed to only stop handing out cmdline sources AFTER we have actually handed out all of them
-                        if ( dir_buf_list_size == 0 ) { start = 0; }
-                    }
-                    else if (!o.recurse)
-                    {
-                        delete_buf_list(&dir_buf_list, &dir_buf_list_tail, &dir_buf_list_size);
-                    }
+                    manager_dispatch_dirs(o, &workers, &plan, &dir_buf_list, &dir_buf_list_tail, &dir_buf_list_size, &start);
+                }
+                manager_dispatch_process(o, &workers, &plan, &process_heap, &process_buf_list, &process_buf_list_tail,
+                                         &process_parked, &process_parked_tail, &process_buf_list_size);
+                if (!plan.readdir_first)
+                {
+                    manager_dispatch_dirs(o, &workers, &plan, &dir_buf_list, &dir_buf_list_tail, &dir_buf_list_size, &start);
                 }
             }
 
             //are we finished?
-            if (process_buf_list_size == 0 && dir_buf_list_size == 0 && processing_complete(proc_status, free_worker_count, nproc))
+            if (process_buf_list_size == 0 && dir_buf_list_size == 0 && processing_complete(&workers))
             {
 
                 break;
@@ -1100,7 +1282,7 @@ int manager(int rank,
         }
 
         // got a message, or nothing left to do
-        if (process_buf_list_size == 0 && dir_buf_list_size == 0 && processing_complete(proc_status, free_worker_count, nproc))
+        if (process_buf_list_size == 0 && dir_buf_list_size == 0 && processing_complete(&workers))
         {
 
             break;
@@ -1110,15 +1292,13 @@ int manager(int rank,
         {
             // we have a message, but maybe not one we want to accept if the queues are too large
 	    // accept only non-work producing messages if the work queue is "full"
-	    int mpi_return = 0;
-
-	    if (process_buf_list_size <= MAXWORKACCUM)
-                mpi_return = MPI_Recv(&type_cmd, 1, MPI_INT, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+	    // (unless we can spill the queues to disk)
+	    if (o.spill_mem || (process_buf_list_size <= MAXWORKACCUM))
+                msg = recv_message(MPI_ANY_SOURCE, MPI_ANY_TAG, &status);
             else
-		mpi_return = MPI_Recv(&type_cmd, 1, MPI_INT, MPI_ANY_SOURCE, MPI_TAG_NOT_MORE_WORK, MPI_COMM_WORLD, &status);
-	    if (mpi_return != MPI_SUCCESS)
-                errsend(FATAL, "Failed to receive type_cmd\n");
+                msg = recv_message(MPI_ANY_SOURCE, MPI_TAG_NOT_MORE_WORK, &status);
 
+            type_cmd = MSG_HDR(msg)->opcode;
             sending_rank = status.MPI_SOURCE;
             PRINT_MPI_DEBUG("rank %d: manager() Receiving the command %s from rank %d\n",
                             rank, cmd2str((OpCode)type_cmd), sending_rank);
@@ -1127,32 +1307,38 @@ int manager(int rank,
             {
             case WORKDONECMD:
                 //worker finished their tasks
-                manager_workdone(rank, sending_rank, proc_status, &free_worker_count, &readdir_rank_count);
+                manager_workdone(rank, sending_rank, msg, &workers);
                 break;
             case NONFATALINCCMD:
                 //non fatal errsend encountered
                 non_fatal++;
                 break;
             case CHUNKBUSYCMD:
-                proc_status[ACCUM_PROC].inuse = 1;
-                // free_worker_count -= 1; // nope.  This is only for rank >= START_PROC
+                // a sub-manager passes along several at once
+                for (i = (MSG_HDR(msg)->count ? MSG_HDR(msg)->count : 1); i > 0; i--)
+                {
+                    set_rank_busy(&workers, ACCUM_PROC, 0, 0);
+                }
                 break;
             case COPYSTATSCMD:
-                manager_add_copy_stats(rank, sending_rank, &num_copied_files, &num_copied_bytes);
+                manager_add_copy_stats(rank, sending_rank, msg, &num_copied_files, &num_copied_bytes);
                 break;
             case EXAMINEDSTATSCMD:
-                manager_add_examined_stats(rank, sending_rank, &examined_file_count, &examined_byte_count, &examined_dir_count, &finished_byte_count);
+                manager_add_examined_stats(rank, sending_rank, msg, &examined_file_count, &examined_byte_count, &examined_dir_count, &finished_byte_count);
                 break;
             case PROCESSCMD:
-                manager_add_buffs(rank, sending_rank, &process_buf_list, &process_buf_list_tail, &process_buf_list_size);
+                manager_add_process_buffs(rank, sending_rank, msg, &process_heap, &process_buf_list_size);
+                msg = NULL; // now queued
                 break;
             case DIRCMD:
-                manager_add_buffs(rank, sending_rank, &dir_buf_list, &dir_buf_list_tail, &dir_buf_list_size);
+                manager_add_buffs(rank, sending_rank, msg, &dir_buf_list, &dir_buf_list_tail, &dir_buf_list_size);
+                msg = NULL; // now queued
                 break;
 
             default:
                 break;
             }
+            free(msg);
         }
 
         // for the "low-verbosity" output, we just periodically report
@@ -1284,6 +1470,7 @@ int manager(int rank,
     //    print, before the footer.]
 
     // (1) shutdown "regular" workers
+    drain_sends();
     for (i = START_PROC; i < nproc; i++)
     {
         send_worker_exit(i);
@@ -1359,6 +1546,12 @@ int manager(int rank,
         write_output(message, 1);
     }
 
+    if (work_spill_count())
+    {
+        sprintf(message, "INFO  FOOTER   Work Buffers Spilled:       %4ld\n", work_spill_count());
+        write_output(message, 1);
+    }
+
     sprintf(message, "INFO  FOOTER   Elapsed Time:               %lf seconds\n", elapsed_time);
     write_output(message, 1);
 
@@ -1370,10 +1563,17 @@ int manager(int rank,
     write_output(message, 1);
 #endif
 
+    if (o.verbose)
+    {
+        report_idle(&waiter, rank);
+    }
+
     // (3) *now* we're done with OUTPUT_PROC.  All other workers have exited.
     send_worker_exit(OUTPUT_PROC); // no need for barrier here ...
 
-    free(proc_status);
+    destroy_worker_pool(&workers);
+    delete_buf_heap(&process_heap, &process_buf_list_size);
+    close_work_spill();
 
     // return nonzero for any errors
     if (0 != non_fatal)
@@ -1383,17 +1583,13 @@ int manager(int rank,
     return 0;
 }
 
-// recv <path_count>, then a block of packed data.  Unpack to individual
-// path_items, pushing onto tail of queue
-int manager_add_paths(int rank, int sending_rank, path_list **queue_head, path_list **queue_tail, int *queue_count)
+// <msg> holds a packed batch.  Unpack to individual path_items, pushing
+// onto tail of queue
+int manager_add_paths(int rank, int sending_rank, const char *msg, path_list **queue_head, path_list **queue_tail, int *queue_count)
 {
-    MPI_Status status;
-    int path_count;
+    int path_count = MSG_HDR(msg)->count;
     path_list *work_node = (path_list *)malloc(sizeof(path_list));
-    char path[PATHSIZE_PLUS] = {0};
-    char *workbuf;
-    int worksize;
-    int position;
+    path_batch_view view;
     int i;
 
     if (!work_node)
@@ -1401,144 +1597,444 @@ int manager_add_paths(int rank, int sending_rank, path_list **queue_head, path_l
         errsend_fmt(FATAL, "Failed to allocate %lu bytes for work_node\n", sizeof(path_list));
     }
 
-    //gather the # of files
-    PRINT_MPI_DEBUG("rank %d: manager_add_paths() Receiving path_count from rank %d\n", rank, sending_rank);
-    if (MPI_Recv(&path_count, 1, MPI_INT, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
-    {
-        errsend(FATAL, "Failed to receive path_count\n");
-    }
-    worksize = path_count * sizeof(path_list);
-    workbuf = (char *)malloc(worksize * sizeof(char));
-    if (!workbuf)
+    if (path_batch_view_init(&view, MSG_PAYLOAD(msg), MSG_HDR(msg)->payload_len) != path_count)
     {
-        errsend_fmt(FATAL, "Failed to allocate %lu bytes for workbuf\n", sizeof(worksize));
+        errsend_fmt(FATAL, "Expected %d items in message from rank %d\n", path_count, sending_rank);
     }
-
-    //gather the path to stat
-    PRINT_MPI_DEBUG("rank %d: manager_add_paths() Receiving worksize from rank %d\n", rank, sending_rank);
-    if (MPI_Recv(workbuf, worksize, MPI_PACKED, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
-    {
-        errsend(FATAL, "Failed to receive worksize\n");
-    }
-
-    position = 0;
     for (i = 0; i < path_count; i++)
     {
         PRINT_MPI_DEBUG("rank %d: manager_add_paths() Unpacking the work_node from rank %d\n", rank, sending_rank);
-        MPI_Unpack(workbuf, worksize, &position, &work_node->data, sizeof(path_item), MPI_CHAR, MPI_COMM_WORLD);
-        // // The following appears to be useless ...
-        // strncpy(path, work_node->data.path, PATHSIZE_PLUS);
+        unpack_path_item(&work_node->data, &view, i);
         enqueue_node(queue_head, queue_tail, work_node, queue_count);
     }
 
     free(work_node);
-    free(workbuf);
     return path_count;
 }
 
-// recv <path_count>, then a block of packed data.  Push block onto a work_buf_list
-void manager_add_buffs(int rank, int sending_rank, work_buf_list **workbuflist, work_buf_list **workbuflisttail, int *workbufsize)
+// Hand out up to <plan>->process_max copy/compare buffers, to free ranks.
+// Each comes from the top of <heap>, unless pieces of one that was split are
+// still waiting in <workbuflist>.  A chunk whose home node ('-N local') has
+// no free rank is parked in <parkedlist>, so the work behind it can go
+// ahead, and tried again first, next time.  <workbufsize> counts all three.
+void manager_dispatch_process(struct options &o, worker_pool *workers, const dispatch_plan *plan, work_buf_heap *heap,
+                              work_buf_list **workbuflist, work_buf_list **workbuftail,
+                              work_buf_list **parkedlist, work_buf_list **parkedtail, int *workbufsize)
 {
-    MPI_Status status;
-    int path_count;
-    char *workbuf;
-    int worksize;
+    work_buf_list *parked;
+    work_buf_list *tail;
+    work_buf_list *buf;
+    int work_rank;
+    int i;
 
-    //gather the # of files
-    PRINT_MPI_DEBUG("rank %d: manager_add_buffs() Receiving path_count from rank %d\n", rank, sending_rank);
-    if (MPI_Recv(&path_count, 1, MPI_INT, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+    if (!workers->free_count || !*workbufsize)
     {
-        errsend(FATAL, "Failed to receive path_count\n");
+        return;
     }
-    worksize = path_count * sizeof(path_list);
-    workbuf = (char *)malloc(worksize * sizeof(char));
-    if (!workbuf)
+    for (i = 0; i < workers->nproc; i++)
     {
-        errsend_fmt(FATAL, "Failed to allocate %lu bytes for workbuf\n", sizeof(workbuf));
+        PRINT_PROC_DEBUG("Rank %d, Status %d\n", i, workers->status[i].inuse);
+    }
+    PRINT_PROC_DEBUG("=============\n");
+    if ((o.work_type != COPYWORK) && (o.work_type != COMPAREWORK))
+    {
+        //delete the queue here
+        delete_buf_heap(heap, workbufsize);
+        delete_buf_list(workbuflist, workbuftail, workbufsize);
+        delete_buf_list(parkedlist, parkedtail, workbufsize);
+        return;
     }
 
-    //gather the path to stat
-    PRINT_MPI_DEBUG("rank %d: manager_add_buffs() Receiving buff from rank %d\n", rank, sending_rank);
-    if (MPI_Recv(workbuf, worksize, MPI_PACKED, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+    // parked chunks first, in order
+    parked = *parkedlist;
+    *parkedlist = NULL;
+    *parkedtail = NULL;
+    while (parked)
     {
-        errsend(FATAL, "Failed to receive worksize\n");
+        buf = parked;
+        parked = buf->next;
+        work_rank = get_placed_rank(workers, COPY_SET, o.placement, buf);
+        if (work_rank < 0)
+        {
+            append_buf_item(buf, parkedlist, parkedtail);
+            continue;
+        }
+        buf->next = NULL;
+        tail = buf;
+        set_rank_busy(workers, work_rank, 0, buf->work_bytes);
+        if (o.work_type == COPYWORK)
+        {
+            send_worker_copy_path(work_rank, &buf, &tail, workbufsize);
+        }
+        else
+        {
+            send_worker_compare_path(work_rank, &buf, &tail, workbufsize);
+        }
     }
-    if (path_count > 0)
+
+    for (i = 0; ((plan->process_max < 0) || (i < plan->process_max)) && *workbufsize; i++)
+    {
+        if (get_free_rank(workers, COPY_SET) < 0)
+        {
+            break;
+        }
+        if (!*workbuflist)
+        {
+            take_buf_heap_top(heap, workbuflist, workbuftail);
+            if (!*workbuflist)
+            {
+                break; // only parked chunks left
+            }
+        }
+        split_buf_list_head(workers, workbuflist, workbuftail, workbufsize);
+        work_rank = get_placed_rank(workers, COPY_SET, o.placement, *workbuflist);
+        if (work_rank < 0)
+        {
+            buf = *workbuflist;
+            *workbuflist = buf->next;
+            if (*workbuftail == buf)
+            {
+                *workbuftail = NULL;
+            }
+            append_buf_item(buf, parkedlist, parkedtail);
+            continue;
+        }
+        set_rank_busy(workers, work_rank, 0, (*workbuflist)->work_bytes);
+        if (o.work_type == COPYWORK)
+        {
+            send_worker_copy_path(work_rank, workbuflist, workbuftail, workbufsize);
+        }
+        else
+        {
+            send_worker_compare_path(work_rank, workbuflist, workbuftail, workbufsize);
+        }
+    }
+}
+
+// Hand out up to <plan>->readdir_max directory buffers, to free ranks, but
+// stop handing out new readdir/stat work if we're over <plan>->readdir_ranks.
+// <start> is set until the command-line sources have all been handed out.
+void manager_dispatch_dirs(struct options &o, worker_pool *workers, const dispatch_plan *plan,
+                           work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize, int *start)
+{
+    int work_rank;
+    int i;
+
+    for (i = 0; ((plan->readdir_max < 0) || (i < plan->readdir_max)) && *workbufsize; i++)
     {
-        enqueue_buf_list(workbuflist, workbuflisttail, workbufsize, workbuf, path_count);
+        if ((plan->readdir_ranks != -1) && (workers->readdir_count >= plan->readdir_ranks))
+        {
+            break;
+        }
+        work_rank = get_free_rank(workers, READDIR_SET);
+        if (work_rank < 0)
+        {
+            break;
+        }
+        if (*start == 1 || o.recurse)
+        {
+            set_rank_busy(workers, work_rank, 1, 0);
+            send_worker_readdir(work_rank, workbuflist, workbuftail, workbufsize);
+            // GRANSOM EDIT:
+            //   Changed to only stop handing out cmdline sources AFTER we have actually handed out all of them
+            if (*workbufsize == 0)
+            {
+                *start = 0;
+            }
+        }
+        else
+        {
+            delete_buf_list(workbuflist, workbuftail, workbufsize);
+        }
     }
 }
 
-void manager_add_copy_stats(int rank, int sending_rank, int *num_copied_files, size_t *num_copied_bytes)
+// copy/compare work is queued largest-first (see work_buf_heap)
+void manager_add_process_buffs(int rank, int sending_rank, char *msg, work_buf_heap *heap, int *workbufsize)
 {
-    MPI_Status status;
-    int num_files;
-    size_t num_bytes;
-    //gather the # of copied files
-    PRINT_MPI_DEBUG("rank %d: manager_add_copy_stats() Receiving num_copied_files from rank %d\n", rank, sending_rank);
-    if (MPI_Recv(&num_files, 1, MPI_INT, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+    int path_count = MSG_HDR(msg)->count;
+
+    PRINT_MPI_DEBUG("rank %d: manager_add_process_buffs() Queueing %d paths from rank %d\n", rank, path_count, sending_rank);
+    if (path_count > 0)
     {
-        errsend(FATAL, "Failed to receive worksize\n");
+        enqueue_buf_heap(heap, workbufsize, msg, path_count, sizeof(msg_hdr) + MSG_HDR(msg)->payload_len);
     }
-    //gather the # of copied byes
-    PRINT_MPI_DEBUG("rank %d: manager_add_copy_stats() Receiving num_copied_bytes from rank %d\n", rank, sending_rank);
-    if (MPI_Recv(&num_bytes, 1, MPI_DOUBLE, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+    else
     {
-        errsend(FATAL, "Failed to receive worksize\n");
+        free(msg);
     }
-    *num_copied_files += num_files;
-    *num_copied_bytes += num_bytes;
 }
 
-void manager_add_examined_stats(int rank, int sending_rank, int *num_examined_files, size_t *num_examined_bytes, int *num_examined_dirs, size_t *num_finished_bytes)
+// <msg> holds a packed batch.  Push the whole message onto a work_buf_list,
+// which takes ownership of it.  It will be forwarded as-is, by
+// send_buffer_list().
+void manager_add_buffs(int rank, int sending_rank, char *msg, work_buf_list **workbuflist, work_buf_list **workbuflisttail, int *workbufsize)
 {
-    MPI_Status status;
-    int num_files = 0;
-    size_t num_bytes = 0;
-    int num_dirs = 0;
-    size_t num_bytes_finished = 0;
+    int path_count = MSG_HDR(msg)->count;
 
-    //gather the # of examined files
-    PRINT_MPI_DEBUG("rank %d: manager_add_examined_stats() Receiving num_examined_files from rank %d\n", rank, sending_rank);
-    if (MPI_Recv(&num_files, 1, MPI_INT, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+    PRINT_MPI_DEBUG("rank %d: manager_add_buffs() Queueing %d paths from rank %d\n", rank, path_count, sending_rank);
+    if (path_count > 0)
     {
-        errsend(FATAL, "Failed to receive worksize\n");
+        enqueue_buf_list(workbuflist, workbuflisttail, workbufsize, msg, path_count, sizeof(msg_hdr) + MSG_HDR(msg)->payload_len);
+        spill_buf_list_tail(*workbuflist, *workbuflisttail);
     }
-    PRINT_MPI_DEBUG("rank %d: manager_add_examined_stats() Receiving num_examined_bytes from rank %d\n", rank, sending_rank);
-    if (MPI_Recv(&num_bytes, 1, MPI_DOUBLE, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+    else
     {
-        errsend(FATAL, "Failed to receive worksize\n");
+        free(msg);
     }
-    PRINT_MPI_DEBUG("rank %d: manager_add_examined_stats() Receiving num_examined_dirs from rank %d\n", rank, sending_rank);
-    if (MPI_Recv(&num_dirs, 1, MPI_INT, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+}
+
+void manager_add_copy_stats(int rank, int sending_rank, const char *msg, int *num_copied_files, size_t *num_copied_bytes)
+{
+    copy_stats_msg stats;
+
+    if (MSG_HDR(msg)->payload_len != sizeof(stats))
     {
-        errsend(FATAL, "Failed to receive worksize\n");
+        errsend_fmt(FATAL, "Bad COPYSTATSCMD payload from rank %d\n", sending_rank);
     }
-    PRINT_MPI_DEBUG("rank %d: manager_add_examined_stats() Receiving num_finished_bytes from rank %d\n", rank, sending_rank);
-    if (MPI_Recv(&num_bytes_finished, 1, MPI_DOUBLE, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+    memcpy(&stats, MSG_PAYLOAD(msg), sizeof(stats));
+    PRINT_MPI_DEBUG("rank %d: manager_add_copy_stats() %ld files, %ld bytes from rank %d\n", rank, stats.num_files, stats.num_bytes, sending_rank);
+    *num_copied_files += stats.num_files;
+    *num_copied_bytes += stats.num_bytes;
+}
+
+void manager_add_examined_stats(int rank, int sending_rank, const char *msg, int *num_examined_files, size_t *num_examined_bytes, int *num_examined_dirs, size_t *num_finished_bytes)
+{
+    examined_stats_msg stats;
+
+    if (MSG_HDR(msg)->payload_len != sizeof(stats))
     {
-        errsend(FATAL, "Failed to receive worksize\n");
+        errsend_fmt(FATAL, "Bad EXAMINEDSTATSCMD payload from rank %d\n", sending_rank);
     }
-
-    *num_examined_files += num_files;
-    *num_examined_bytes += num_bytes;
-    *num_examined_dirs += num_dirs;
-    *num_finished_bytes += num_bytes_finished;
+    memcpy(&stats, MSG_PAYLOAD(msg), sizeof(stats));
+    PRINT_MPI_DEBUG("rank %d: manager_add_examined_stats() %ld files, %ld bytes, %ld dirs from rank %d\n", rank, stats.num_files, stats.num_bytes, stats.num_dirs, sending_rank);
+    *num_examined_files += stats.num_files;
+    *num_examined_bytes += stats.num_bytes;
+    *num_examined_dirs += stats.num_dirs;
+    *num_finished_bytes += stats.num_finished_bytes;
 }
 
-void manager_workdone(int rank, int sending_rank, struct worker_proc_status *proc_status, int *free_worker_count, int *readdir_rank_count)
+void manager_workdone(int rank, int sending_rank, const char *msg, worker_pool *workers)
 {
-    if (proc_status[sending_rank].inuse)
+    int i;
+
+    if (MSG_HDR(msg)->payload_len == sizeof(workdone_msg))
     {
-        proc_status[sending_rank].inuse = 0;
-        if (sending_rank >= START_PROC)
-            *free_worker_count += 1;
+        // work-stealing: one buffer finished, and maybe some new ones queued
+        workdone_msg done;
+        memcpy(&done, MSG_PAYLOAD(msg), sizeof(done));
+        workers->pending_bufs += done.created - 1;
+        return;
     }
-    if (proc_status[sending_rank].readdir)
+
+    // a sub-manager reports several finished buffers at once
+    for (i = (MSG_HDR(msg)->count ? MSG_HDR(msg)->count : 1); i > 0; i--)
     {
-        proc_status[sending_rank].readdir = 0;
-        *readdir_rank_count -= 1;
+        set_rank_free(workers, sending_rank);
+    }
+}
+
+// With '-H', one worker rank per node is a sub-manager.  The manager treats
+// it as one rank with a slot for each worker on its node, and hands it
+// work.  We hand that out to our own workers, and collect their WORKDONE
+// and stats.  Work our workers discover is kept here, as long as we have
+// fewer buffers queued than workers; the rest goes up to the manager, so
+// other nodes can have it.
+//
+// <held> counts buffers the manager has handed us, that it thinks are still
+// in progress.  We only tell the manager they're done once there isn't
+// that much left to do here (queued or running), and we report everything
+// that has accumulated since the last report at once.  Stats are sent
+// every SUBMGR_REPORT_SECS, or when we go idle, and CHUNKBUSY counts always
+// go before the WORKDONE that might otherwise let the manager finish
+// without waiting for ACCUM_PROC.
+//
+// The manager sends EXITCMD to our workers itself.
+void sub_manager(int rank, struct options &o, int nproc, const int *managers, const int *nodes, wait_state *waiter)
+{
+    MPI_Status status;
+    int message_ready = 0;
+    int type_cmd;
+    char *msg;
+    int work_rank;
+    int sending_rank;
+    int all_done = 0;
+    worker_pool workers;
+
+    work_buf_list *process_buf_list = NULL;
+    work_buf_list *process_buf_list_tail = NULL;
+    int process_buf_list_size = 0;
+
+    work_buf_list *dir_buf_list = NULL;
+    work_buf_list *dir_buf_list_tail = NULL;
+    int dir_buf_list_size = 0;
+
+    int held = 0;       // buffers from the manager, not yet reported done
+    int active;         // buffers queued or running here
+    int chunk_busy = 0; // CHUNKBUSY not yet passed along
+    int copied_files = 0;
+    size_t copied_bytes = 0;
+    int examined_files = 0;
+    size_t examined_bytes = 0;
+    int examined_dirs = 0;
+    size_t finished_bytes = 0;
+    double next_stats = MPI_Wtime() + SUBMGR_REPORT_SECS;
+
+    init_worker_pool(&workers, nproc, managers, nodes, rank);
+    PRINT_PROC_DEBUG("rank %d: sub_manager() feeding %d workers\n", rank, workers.nslots);
+
+    while (all_done == 0)
+    {
+        // hand out whatever we can
+        while (workers.free_count && process_buf_list_size)
+        {
+            work_rank = get_free_rank(&workers, COPY_SET);
+            if (work_rank < 0)
+            {
+                break;
+            }
+            split_buf_list_head(&workers, &process_buf_list, &process_buf_list_tail, &process_buf_list_size);
+            set_rank_busy(&workers, work_rank, 0, process_buf_list->work_bytes);
+            if (o.work_type == COPYWORK)
+            {
+                send_worker_copy_path(work_rank, &process_buf_list, &process_buf_list_tail, &process_buf_list_size);
+            }
+            else
+            {
+                send_worker_compare_path(work_rank, &process_buf_list, &process_buf_list_tail, &process_buf_list_size);
+            }
+        }
+        while (workers.free_count && dir_buf_list_size)
+        {
+            work_rank = get_free_rank(&workers, READDIR_SET);
+            if (work_rank < 0)
+            {
+                break;
+            }
+            set_rank_busy(&workers, work_rank, 1, 0);
+            send_worker_readdir(work_rank, &dir_buf_list, &dir_buf_list_tail, &dir_buf_list_size);
+        }
+
+        // report to the manager
+        active = (workers.nslots - workers.free_count) + process_buf_list_size + dir_buf_list_size;
+        if ((copied_files || copied_bytes) && (!active || (MPI_Wtime() >= next_stats)))
+        {
+            send_manager_copy_stats(copied_files, copied_bytes);
+            copied_files = 0;
+            copied_bytes = 0;
+        }
+        if ((examined_files || examined_bytes || examined_dirs || finished_bytes) && (!active || (MPI_Wtime() >= next_stats)))
+        {
+            send_manager_examined_stats(examined_files, examined_bytes, examined_dirs, finished_bytes);
+            examined_files = 0;
+            examined_bytes = 0;
+            examined_dirs = 0;
+            finished_bytes = 0;
+        }
+        if (MPI_Wtime() >= next_stats)
+        {
+            next_stats = MPI_Wtime() + SUBMGR_REPORT_SECS;
+        }
+        if (held > active)
+        {
+            if (chunk_busy)
+            {
+                send_message(MANAGER_PROC, CHUNKBUSYCMD, chunk_busy, NULL, 0, MPI_TAG_NOT_MORE_WORK);
+                chunk_busy = 0;
+            }
+            send_message(MANAGER_PROC, WORKDONECMD, held - active, NULL, 0, MPI_TAG_NOT_MORE_WORK);
+            held = active;
+        }
+
+        // Take everything that's waiting, before the next round of reports.
+        // We only block if everything is handed out, and reported.
+        message_ready = wait_for_message(waiter, !(workers.free_count && (process_buf_list_size || dir_buf_list_size)), &status);
+        while (message_ready)
+        {
+            msg = recv_message(MPI_ANY_SOURCE, MPI_ANY_TAG, &status);
+            type_cmd = MSG_HDR(msg)->opcode;
+            sending_rank = status.MPI_SOURCE;
+            PRINT_MPI_DEBUG("rank %d: sub_manager() Receiving the command %s from rank %d\n",
+                            rank, cmd2str((OpCode)type_cmd), sending_rank);
+            switch (type_cmd)
+            {
+            case COPYCMD:
+            case COMPARECMD:
+                held++;
+                take_batch_level(msg);
+                manager_add_buffs(rank, sending_rank, msg, &process_buf_list, &process_buf_list_tail, &process_buf_list_size);
+                msg = NULL; // now queued
+                break;
+            case PROCESSCMD:
+                if (o.work_type == LSWORK)
+                {
+                    break; // the listing is already done
+                }
+                if (process_buf_list_size + dir_buf_list_size < workers.nslots)
+                {
+                    manager_add_buffs(rank, sending_rank, msg, &process_buf_list, &process_buf_list_tail, &process_buf_list_size);
+                }
+                else
+                {
+                    send_message_async(MANAGER_PROC, msg, MPI_TAG_MORE_WORK);
+                }
+                msg = NULL; // now queued
+                break;
+            case DIRCMD:
+                if (sending_rank == MANAGER_PROC)
+                {
+                    held++;
+                    take_batch_level(msg);
+                    manager_add_buffs(rank, sending_rank, msg, &dir_buf_list, &dir_buf_list_tail, &dir_buf_list_size);
+                }
+                else if (!o.recurse)
+                {
+                    break;
+                }
+                else if (process_buf_list_size + dir_buf_list_size < workers.nslots)
+                {
+                    manager_add_buffs(rank, sending_rank, msg, &dir_buf_list, &dir_buf_list_tail, &dir_buf_list_size);
+                }
+                else
+                {
+                    send_message_async(MANAGER_PROC, msg, MPI_TAG_MORE_WORK);
+                }
+                msg = NULL; // now queued
+                break;
+            case WORKDONECMD:
+                set_rank_free(&workers, sending_rank);
+                break;
+            case CHUNKBUSYCMD:
+                chunk_busy++;
+                break;
+            case COPYSTATSCMD:
+                manager_add_copy_stats(rank, sending_rank, msg, &copied_files, &copied_bytes);
+                break;
+            case EXAMINEDSTATSCMD:
+                manager_add_examined_stats(rank, sending_rank, msg, &examined_files, &examined_bytes, &examined_dirs, &finished_bytes);
+                break;
+            case EXITCMD:
+                all_done = 1;
+                break;
+            default:
+                errsend_fmt(FATAL, "sub-manager received unrecognized command %s\n", cmd2str((OpCode)type_cmd));
+                break;
+            }
+            free(msg);
+            if (all_done)
+            {
+                break;
+            }
+            if (MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &message_ready, &status) != MPI_SUCCESS)
+            {
+                errsend(FATAL, "MPI_Iprobe failed\n");
+            }
+        }
     }
+
+    delete_buf_list(&process_buf_list, &process_buf_list_tail, &process_buf_list_size);
+    delete_buf_list(&dir_buf_list, &dir_buf_list_tail, &dir_buf_list_size);
+    destroy_worker_pool(&workers);
 }
 
 void worker_add_timing_data(int sending_rank) {}
@@ -1546,7 +2042,7 @@ void worker_show_timing_data(int sending_rank, struct options &o) {}
 
 
 //worker
-void worker(int rank, struct options &o)
+void worker(int rank, struct options &o, const int *managers, const int *nodes)
 {
     MPI_Status status;
     int sending_rank;
@@ -1554,36 +2050,30 @@ void worker(int rank, struct options &o)
     int makedir = 0;
     int message_ready = 0;
     int probecount = 0;
-    int prc;
-    char *output_buffer = (char *)NULL;
+    wait_state waiter;
     int type_cmd;
+    char *msg;
     int mpi_ret_code;
     char base_path[PATHSIZE_PLUS] = {0};
+
+    // work-stealing
+    int nproc;
+    int local_work = (o.work_stealing && (rank >= START_PROC));
+    int steal_victim = -1; // rank we've sent a STEALCMD, awaiting the reply
+    double next_steal = 0;
+    useconds_t steal_backoff = STEAL_BACKOFF_MIN;
+    unsigned int steal_seed = rank;
     path_item dest_node = {0};
 
     //variables stored by the 'accumulator' proc
     HASHTBL *chunk_hash;
     int base_count = 100;
     int hash_count = 0;
-    int output_count = 0;
 
     // OUTPUT_PROC could just skip the bcasts of dest_node and base path
     // (if we used a communicator without him).  OUTPUT_PROC won't need
     // those, and waiting at the Bcast means anybody else who calls
     // errsend() before hitting the Bcast will deadlock everything.
-    if (rank == OUTPUT_PROC)
-    {
-        const size_t obuf_size = MESSAGEBUFFER * MESSAGESIZE * sizeof(char);
-        output_buffer = (char *)malloc(obuf_size);
-        if (!output_buffer)
-        {
-            fprintf(stderr, "OUTPUT_PROC Failed to allocate %lu bytes "
-                            "for output_buffer\n",
-                    obuf_size);
-            MPI_Abort(MPI_COMM_WORLD, -1);
-        }
-        memset(output_buffer, '\0', obuf_size);
-    }
     if (o.work_type == COPYWORK)
     {
         makedir = 1;
@@ -1628,63 +2118,118 @@ void worker(int rank, struct options &o)
         }
     }
 
+    MPI_Comm_size(MPI_COMM_WORLD, &nproc);
+    if (local_work)
+    {
+        init_local_work(o.work_type, o.recurse);
+    }
+
     //change this to get request first, process, then get work
+    wait_init(&waiter, o.wait_mode);
+    if (sub_manager_workers(managers, nproc, rank))
+    {
+        sub_manager(rank, o, nproc, managers, nodes, &waiter);
+        all_done = 1;
+    }
+    else if (rank >= START_PROC)
+    {
+        start_worker_threads(o.worker_threads);
+    }
     while (all_done == 0)
     {
+        msg = NULL;
+
         //poll for message
         while (message_ready == 0)
         {
-            prc = MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &message_ready, &status);
-            if (prc != MPI_SUCCESS)
+            // With work-stealing, answer our peers first, then do our own
+            // queued work, and only then go looking for someone else's.
+            if (local_work)
             {
-                errsend(FATAL, "MPI_Iprobe failed\n");
+                if (MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &message_ready, &status) != MPI_SUCCESS)
+                {
+                    errsend(FATAL, "MPI_Iprobe failed\n");
+                }
+                if (message_ready || (msg = pop_local_work()))
+                {
+                    break;
+                }
+                if ((steal_victim < 0) && (nproc - START_PROC > 1) && (MPI_Wtime() >= next_steal))
+                {
+                    // a random worker other than ourselves
+                    steal_victim = START_PROC + rand_r(&steal_seed) % (nproc - START_PROC - 1);
+                    if (steal_victim >= rank)
+                    {
+                        steal_victim++;
+                    }
+                    send_command(steal_victim, STEALCMD, MPI_TAG_NOT_MORE_WORK);
+                }
             }
-            else
-                probecount++;
+            message_ready = wait_for_message(&waiter, (!local_work || (steal_victim >= 0)), &status);
+            probecount++;
 
             if (probecount % 3000 == 0)
             {
                 PRINT_POLL_DEBUG("Rank %d: Waiting for a message\n", rank);
             }
-            if (!message_ready)
-                usleep(1);
         }
 
-        //recv message-type
-        if (MPI_Recv(&type_cmd, 1, MPI_INT, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+        if (msg)
+        {
+            sending_rank = rank; // from our own queue
+        }
+        else
         {
-            errsend(FATAL, "Failed to receive type_cmd\n");
+            //recv the whole message
+            msg = recv_message(MPI_ANY_SOURCE, MPI_ANY_TAG, &status);
+            sending_rank = status.MPI_SOURCE;
         }
-        sending_rank = status.MPI_SOURCE;
+        type_cmd = MSG_HDR(msg)->opcode;
         PRINT_MPI_DEBUG("rank %d: worker() Receiving the type_cmd %s from rank %d\n",
                         rank, cmd2str((OpCode)type_cmd), sending_rank);
 
+        // the victim of our STEALCMD sends either work, or NOWORKCMD
+        if ((sending_rank == steal_victim) && (type_cmd != STEALCMD))
+        {
+            steal_victim = -1;
+            if (type_cmd == NOWORKCMD)
+            {
+                next_steal = MPI_Wtime() + steal_backoff / 1e6;
+                steal_backoff *= 2;
+                if (steal_backoff > STEAL_BACKOFF_MAX)
+                {
+                    steal_backoff = STEAL_BACKOFF_MAX;
+                }
+            }
+            else
+            {
+                steal_backoff = STEAL_BACKOFF_MIN;
+            }
+        }
+
         //do operations based on the message-type
+        take_batch_level(msg);
         switch (type_cmd)
         {
         case BUFFEROUTCMD:
-            worker_buffer_output(rank, sending_rank, output_buffer, &output_count, o);
-            break;
-        case OUTCMD:
-            worker_output(rank, sending_rank, 0, output_buffer, &output_count, o);
-            break;
-        case LOGCMD:
-            worker_output(rank, sending_rank, 1, output_buffer, &output_count, o);
-            break;
-        case LOGONLYCMD:
-            worker_output(rank, sending_rank, 2, output_buffer, &output_count, o);
+            worker_buffer_output(rank, sending_rank, msg, o);
             break;
         case UPDCHUNKCMD:
-            worker_update_chunk(rank, sending_rank, &chunk_hash, &hash_count, base_path, &dest_node, o);
+            worker_update_chunk(rank, sending_rank, msg, &chunk_hash, &hash_count, base_path, &dest_node, o);
             break;
         case DIRCMD:
-            worker_readdir(rank, sending_rank, base_path, &dest_node, 0, makedir, o);
+            worker_readdir(rank, sending_rank, msg, base_path, &dest_node, 0, makedir, o);
             break;
         case COPYCMD:
-            worker_copylist(rank, sending_rank, base_path, &dest_node, o);
+            worker_copylist(rank, sending_rank, msg, base_path, &dest_node, o);
             break;
         case COMPARECMD:
-            worker_comparelist(rank, sending_rank, base_path, &dest_node, o);
+            worker_comparelist(rank, sending_rank, msg, base_path, &dest_node, o);
+            break;
+        case STEALCMD:
+            worker_give_work(rank, sending_rank);
+            break;
+        case NOWORKCMD:
             break;
 
         case EXITCMD:
@@ -1694,8 +2239,14 @@ void worker(int rank, struct options &o)
             errsend(FATAL, "worker received unrecognized command\n");
             break;
         }
+        free(msg);
         message_ready = 0;
     }
+    stop_worker_threads();
+    if (o.snapshot_dir[0])
+    {
+        close_snapshot_index(o.snapshot_dir, rank);
+    }
 #ifdef MARFS
     // Close our MarFS stream as late as possible
     if ( !MARFS_Path::close_packedfh() )
@@ -1704,20 +2255,25 @@ void worker(int rank, struct options &o)
     }
 #endif
 
+    if (o.verbose)
+    {
+        report_idle(&waiter, rank);
+    }
+
     // cleanup
     if (rank == OUTPUT_PROC)
     {
-        worker_flush_output(output_buffer, &output_count);
-        free(output_buffer);
         // no need for barrier ...
     }
     else if (rank == ACCUM_PROC)
     {
         hashtbl_destroy(chunk_hash);
+        drain_sends();
         MPI_Barrier(accum_comm);
     }
     else
     {
+        drain_sends();
         MPI_Barrier(worker_comm);
     }
 }
@@ -1749,47 +2305,34 @@ void worker(int rank, struct options &o)
 
 void worker_update_chunk(int rank,
                          int sending_rank,
+                         const char *msg,
                          HASHTBL **chunk_hash,
                          int *hash_count,
                          const char *base_path,
                          path_item *dest_node,
                          struct options &o)
 {
-    MPI_Status status;
     int path_count;
     path_item work_node = {0};
     path_item out_node = {0};
     path_item out_node_temp = {0};
-    char *workbuf;
-    int worksize;
-    int position;
     HASHDATA *hash_value;
     int i;
 
     //gather the # of files
-    if (MPI_Recv(&path_count, 1, MPI_INT, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
-    {
-        errsend(FATAL, "Failed to receive path_count\n");
-    }
+    path_count = MSG_HDR(msg)->count;
     PRINT_MPI_DEBUG("rank %d: worker_update_chunk() Receiving path_count from rank %d (path_count = %d)\n", rank, sending_rank, path_count);
-    worksize = path_count * sizeof(path_list);
-    workbuf = (char *)malloc(worksize * sizeof(char));
-    if (!workbuf)
-    {
-        errsend_fmt(FATAL, "Failed to allocate %lu bytes for workbuf\n", sizeof(workbuf));
-    }
-
     //get the work nodes
-    if (MPI_Recv(workbuf, worksize, MPI_PACKED, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+    path_batch_view view;
+    if (path_batch_view_init(&view, MSG_PAYLOAD(msg), MSG_HDR(msg)->payload_len) != path_count)
     {
-        errsend(FATAL, "Failed to receive worksize\n");
+        errsend_fmt(FATAL, "Expected %d items in message from rank %d\n", path_count, sending_rank);
     }
 
     // process list of paths with completed chunks
-    position = 0;
     for (i = 0; i < path_count; i++)
     {
-        MPI_Unpack(workbuf, worksize, &position, &work_node, sizeof(path_item), MPI_CHAR, MPI_COMM_WORLD);
+        unpack_path_item(&work_node, &view, i);
 
         PRINT_MPI_DEBUG("rank %d: worker_update_chunk() Unpacking the work_node from rank %d (chunk %d of file '%s')\n", rank, sending_rank, work_node.chkidx, work_node.path);
 
@@ -1879,7 +2422,6 @@ void worker_update_chunk(int rank,
             update_stats(p_work, p_out, o);
         }
     }
-    free(workbuf);
     send_manager_work_done(rank);
 }
 
@@ -1887,96 +2429,174 @@ void worker_update_chunk(int rank,
 // log == 1    output to syslog (AND stdout)
 // log == 2    output to syslog (ONLY)
 //
-void worker_output(int rank, int sending_rank, int log, char *output_buffer, int *output_count, struct options &o)
+void worker_output(int rank, int sending_rank, const char *text, int log, struct options &o)
 {
-    //have a worker receive and print a single message
-    MPI_Status status;
-    char msg[MESSAGESIZE] = {0};
-
-    //gather the message to print
-    if (MPI_Recv(msg, MESSAGESIZE, MPI_CHAR, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
-    {
-        errsend(FATAL, "Failed to receive msg\n");
-    }
-    PRINT_MPI_DEBUG("rank %d: worker_output() Receiving the message from rank %d\n", rank, sending_rank);
+    //have a worker print a single message
     if (log && o.logging)
     {
-        syslog(LOG_INFO, "%s", msg);
+        syslog(LOG_INFO, "%s", text);
     }
     if (log < 2)
     {
 #ifdef CONDUIT
-        if (sending_rank == MANAGER_PROC  ||  strncmp( msg, "#CONDUIT-MSG ", 13 ) == 0)
+        if (sending_rank == MANAGER_PROC  ||  strncmp( text, "#CONDUIT-MSG ", 13 ) == 0)
 #else
         if (sending_rank == MANAGER_PROC)
 #endif
         {
-            printf("%s", msg);
+            fputs(text, stdout);
         }
         else
         {
-            printf("RANK %3d: %s", sending_rank, msg);
+            printf("RANK %3d: %s", sending_rank, text);
+        }
+    }
+}
+
+void worker_buffer_output(int rank, int sending_rank, const char *msg, struct options &o)
+{
+    //have a worker print a batch of output_recs
+    int message_count = MSG_HDR(msg)->count;
+    const char *buffer = MSG_PAYLOAD(msg);
+    int buffersize = MSG_HDR(msg)->payload_len;
+    output_rec rec;
+    int position = 0;
+    int i;
+
+    PRINT_MPI_DEBUG("rank %d: worker_buffer_output() Printing %d lines from rank %d\n", rank, message_count, sending_rank);
+    for (i = 0; i < message_count; i++)
+    {
+        if (buffersize - position < (int)sizeof(rec))
+        {
+            errsend_fmt(FATAL, "Short output buffer from rank %d\n", sending_rank);
+        }
+        memcpy(&rec, buffer + position, sizeof(rec));
+        position += sizeof(rec);
+        if ((rec.len == 0) || (rec.len > (uint32_t)(buffersize - position)) || buffer[position + rec.len - 1])
+        {
+            errsend_fmt(FATAL, "Bad output record from rank %d\n", sending_rank);
+        }
+        worker_output(rank, sending_rank, buffer + position, rec.log, o);
+        position += rec.len;
+    }
+    fflush(stdout);
+}
+
+// With work-stealing, another worker has run out of work, and wants some of
+// ours.
+void worker_give_work(int rank, int sending_rank)
+{
+    char *work = steal_local_work();
+
+    if (work)
+    {
+        PRINT_MPI_DEBUG("rank %d: worker_give_work() giving %s to rank %d\n", rank, cmd2str((OpCode)MSG_HDR(work)->opcode), sending_rank);
+        send_message_async(sending_rank, work, MPI_TAG_NOT_MORE_WORK);
+    }
+    else
+    {
+        send_command(sending_rank, NOWORKCMD, MPI_TAG_NOT_MORE_WORK);
+    }
+}
+
+// Names waiting to be stat'ed, for worker_readdir().  Each stat is a round
+// trip on a network file system, so with '-y' a whole batch of them runs
+// at once on the worker threads (see run_worker_threads()).
+typedef struct stat_pipeline
+{
+    path_item items[STAT_PIPELINE]; // path filled in; the rest by stat_pipeline_item()
+    int ok[STAT_PIPELINE];          // stat succeeded
+    int count;
+    Path *dir;                      // open directory holding the names, or NULL
+    size_t name_off;                // where the name starts, in items[].path
+} stat_pipeline;
+
+static void stat_pipeline_item(void *arg, int i)
+{
+    stat_pipeline *pending = (stat_pipeline *)arg;
+    path_item &item = pending->items[i];
+
+    if (item.st.st_mode)
+    {
+        pending->ok[i] = 1; // already known from the dirent (see worker_readdir())
+    }
+    else if (pending->dir)
+    {
+        pending->ok[i] = pending->dir->stat_entry(item.path + pending->name_off, &item);
+    }
+    else
+    {
+        PathPtr p_new = PathFactory::create(item.path);
+
+        pending->ok[i] = p_new->exists();
+        if (pending->ok[i])
+        {
+            item = p_new->node();
         }
-        fflush(stdout);
     }
 }
 
-void worker_buffer_output(int rank, int sending_rank, char *output_buffer, int *output_count, struct options &o)
+// Stat everything in <pending>, and add the results to <workbuffer> in order,
+// just as if they'd been stat'ed one at a time.  Entries read from a
+// directory stop at the first that fails (returning 0).  Names from a
+// split directory (START_SPLIT) just skip it.
+static int flush_stat_pipeline(stat_pipeline *pending, path_item *workbuffer, int *buffer_count, double *buffer_since,
+                               const char *base_path, path_item *dest_node, struct options &o, int rank)
 {
-    //have a worker receive and print a single message
-    MPI_Status status;
-    int message_count;
-    char msg[MESSAGESIZE] = {0};
-    char *buffer;
-    int buffersize;
-    int position;
+    int count = pending->count;
     int i;
 
-    //gather the message_count
-    PRINT_MPI_DEBUG("rank %d: worker_buffer_output() Receiving the message_count from %d\n", rank, sending_rank);
-    if (MPI_Recv(&message_count, 1, MPI_INT, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
-    {
-        errsend(FATAL, "Failed to receive message_count\n");
-    }
-    buffersize = MESSAGESIZE * message_count;
-    buffer = (char *)malloc(buffersize * sizeof(char));
-    if (!buffer)
+    run_worker_threads(count, stat_pipeline_item, pending);
+    pending->count = 0;
+    for (i = 0; i < count; i++)
     {
-        errsend_fmt(FATAL, "Failed to allocate %lu bytes for workbuf\n", buffersize);
-    }
+        path_item &item = pending->items[i];
 
-    //gather the path to stat
-    PRINT_MPI_DEBUG("rank %d: worker_buffer_output() Receiving the buffer from %d\n", rank, sending_rank);
-    if (MPI_Recv(buffer, buffersize, MPI_PACKED, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
-    {
-        errsend(FATAL, "Failed to receive buffer\n");
-    }
-    position = 0;
-    for (i = 0; i < message_count; i++)
-    {
-        PRINT_MPI_DEBUG("rank %d: worker_buffer_output() Unpacking the message from %d\n", rank, sending_rank);
-        MPI_Unpack(buffer, buffersize, &position, msg, MESSAGESIZE, MPI_CHAR, MPI_COMM_WORLD);
-        if (strlen(msg) > 10) { // only emit messages with content
-            printf("RANK %3d: %s", sending_rank, msg);
-	}
+        if (!pending->ok[i])
+        {
+            // GRANSOM EDIT : Altered to make 'stat' failure NONFATAL, even if o.work_type != LSWORK
+            errsend_fmt(NONFATAL, "Failed to stat path (2) '%s'\n", item.path);
+            if (item.start != START_SPLIT)
+            {
+                return 0;
+            }
+            continue;
+        }
+        if (!S_ISREG(item.st.st_mode) && !S_ISDIR(item.st.st_mode) && !S_ISLNK(item.st.st_mode))
+        {
+            continue;
+        }
+        workbuffer[*buffer_count] = item;
+        *buffer_count += 1;
+        if (batch_ready(BATCH_STATS, *buffer_count, *buffer_since))
+        {
+            process_stat_buffer(workbuffer, buffer_count, base_path, dest_node, o, rank);
+            *buffer_since = MPI_Wtime();
+        }
     }
-    free(buffer);
-    fflush(stdout);
+    return 1;
 }
 
-void worker_flush_output(char *output_buffer, int *output_count)
+// queue <path> in <pending>, for flush_stat_pipeline().  If <dir> is
+// given, <path> is an entry of that open directory, starting at
+// <name_off>.  Everything in the pipeline must come from the same <dir>.
+static path_item *push_stat_pipeline(stat_pipeline *pending, const char *path, int start,
+                                     Path *dir = NULL, size_t name_off = 0)
 {
-    if (*output_count > 0)
-    {
-        printf("%s", output_buffer);
-        (*output_count) = 0;
-        memset(output_buffer, '\0', sizeof(output_count));
-    }
+    path_item &item = pending->items[pending->count++];
+
+    memset(&item, 0, sizeof(path_item));
+    strncpy(item.path, path, PATHSIZE_PLUS);
+    item.start = start;
+    pending->dir = dir;
+    pending->name_off = name_off;
+    return &item;
 }
 
 //When a worker is told to readdir, it comes here
 void worker_readdir(int rank,
                     int sending_rank,
+                    const char *msg,
                     const char *base_path,
                     path_item *dest_node,
                     int start,
@@ -1984,10 +2604,6 @@ void worker_readdir(int rank,
                     struct options &o)
 {
 
-    MPI_Status status;
-    char *workbuf;
-    int worksize;
-    int position;
     int read_count;
     char path[PATHSIZE_PLUS] = {0};
     char full_path[PATHSIZE_PLUS] = {0};
@@ -1999,6 +2615,13 @@ void worker_readdir(int rank,
     path_item work_node = {0};
     path_item workbuffer[STATBUFFER] = {0};
     int buffer_count = 0;
+    double buffer_since = MPI_Wtime(); // for batch_ready()
+    stat_pipeline pending;             // names not yet stat'ed
+    path_item splitbuffer[SPLITDIR_BATCH] = {0}; // names for other ranks to stat
+    int split_count = 0;
+    size_t dir_entries;
+    std::vector<DirEntry> dir_batch;   // from readdir_batch()
+    char *dirent_buf = NULL;           // names in <dir_batch> point in here
     DIR *dip;
     struct dirent *dit;
     start = 1;
@@ -2008,31 +2631,38 @@ void worker_readdir(int rank,
 
     // recv number of path_items being sent
     PRINT_MPI_DEBUG("rank %d: worker_readdir() Receiving the read_count %d\n", rank, sending_rank);
-    if (MPI_Recv(&read_count, 1, MPI_INT, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
-    {
-        errsend(FATAL, "Failed to receive read_count\n");
-    }
-
-    worksize = read_count * sizeof(path_list);
-    workbuf = (char *)malloc(worksize * sizeof(char));
-    if (!workbuf)
-    {
-        errsend_fmt(FATAL, "Failed to allocate %lu bytes for workbuf\n", worksize);
-    }
+    read_count = MSG_HDR(msg)->count;
 
     //recv packed path_items
     PRINT_MPI_DEBUG("rank %d: worker_readdir() Receiving the workbuf %d\n", rank, sending_rank);
-    if (MPI_Recv(workbuf, worksize, MPI_PACKED, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+    path_batch_view view;
+    if (path_batch_view_init(&view, MSG_PAYLOAD(msg), MSG_HDR(msg)->payload_len) != read_count)
     {
-        errsend(FATAL, "Failed to receive workbuf\n");
+        errsend_fmt(FATAL, "Expected %d items in message from rank %d\n", read_count, sending_rank);
     }
 
     // unpack and process successive source-paths
-    position = 0;
+    pending.count = 0;
     for (i = 0; i < read_count; i++)
     {
         PRINT_MPI_DEBUG("rank %d: worker_readdir() Unpacking the work_node %d\n", rank, sending_rank);
-        MPI_Unpack(workbuf, worksize, &position, &work_node, sizeof(path_item), MPI_CHAR, MPI_COMM_WORLD);
+        unpack_path_item(&work_node, &view, i);
+
+        // a name read from a huge directory, by another rank
+        if (work_node.start == START_SPLIT)
+        {
+            push_stat_pipeline(&pending, work_node.path, START_SPLIT);
+            if (pending.count == STAT_PIPELINE)
+            {
+                flush_stat_pipeline(&pending, workbuffer, &buffer_count, &buffer_since, base_path, dest_node, o, rank);
+            }
+            continue;
+        }
+        if (pending.count)
+        {
+            flush_stat_pipeline(&pending, workbuffer, &buffer_count, &buffer_since, base_path, dest_node, o, rank);
+        }
+
         // <p_work> is an appropriately-selected Path subclass, which has
         // an _item member that points to <work_node>
         PRINT_MPI_DEBUG("rank %d: worker_readdir() PathFactory::cast(%d)\n", rank, (unsigned)work_node.ftype);
@@ -2045,10 +2675,18 @@ void worker_readdir(int rank,
                 errsend_fmt(((o.work_type == LSWORK) ? NONFATAL : FATAL),
                             "Failed to stat path (1) '%s'\n", p_work->path());
                 if (o.work_type == LSWORK)
+                {
+                    free(dirent_buf);
                     return;
+                }
             }
             workbuffer[buffer_count] = work_node;
             buffer_count++;
+            if (batch_ready(BATCH_STATS, buffer_count, buffer_since))
+            {
+                process_stat_buffer(workbuffer, &buffer_count, base_path, dest_node, o, rank);
+                buffer_since = MPI_Wtime();
+            }
         }
         else
         {
@@ -2132,19 +2770,33 @@ void worker_readdir(int rank,
             char *append_path = path + path_len; // ptr to end of directory-name
             size_t append_len = PATHSIZE_PLUS - path_len;
 
-            // Use readdir() to append each directory-entry directly onto
-            // to the tail of <path>.  Path::readdir() returns false only
-            // for errors.  EOF is signalled by returning with a
-            // zero-length entry.
+            // Use readdir_batch() to read directory-entries a buffer-full
+            // at a time, and append each name onto the tail of <path>.
+            // Path::readdir_batch() returns false only for errors.  EOF is
+            // signalled by returning no entries.
+            //
+            // Past SPLITDIR_ENTRIES, we just collect the names, and send
+            // them out for other ranks to stat.
+            if (!dirent_buf && !(dirent_buf = (char *)malloc(DIRENT_BUFSIZE)))
+            {
+                errsend_fmt(FATAL, "Failed to allocate %d bytes for directory entries\n", DIRENT_BUFSIZE);
+            }
             bool readdir_p;
-            while (readdir_p = p_work->readdir(append_path, append_len))
+            bool dir_done = false; // a failed stat ends the directory
+            dir_entries = 0;
+            while (!dir_done && (readdir_p = p_work->readdir_batch(dir_batch, dirent_buf, DIRENT_BUFSIZE)))
             {
-                if (!*append_path)
+                if (dir_batch.empty())
                 {
                     break; // end of directory entries
                 }
-                if (strncmp(append_path, ".", PATHSIZE_PLUS) != 0 && strncmp(append_path, "..", PATHSIZE_PLUS) != 0)
+                for (std::vector<DirEntry>::const_iterator ent = dir_batch.begin(); ent != dir_batch.end(); ++ent)
                 {
+                    if (!strcmp(ent->name, ".") || !strcmp(ent->name, ".."))
+                    {
+                        continue;
+                    }
+                    strncpy(append_path, ent->name, append_len);
 
                     // check to see if we should skip it
                     if (0 == fnmatch(o.exclude, path, 0))
@@ -2154,36 +2806,57 @@ void worker_readdir(int rank,
                             output_fmt(1, "Excluding: '%s'\n", path);
                         }
                     }
-                    else
+                    else if ((ent->type == DT_FIFO) || (ent->type == DT_SOCK) || (ent->type == DT_CHR) || (ent->type == DT_BLK))
+                    {
+                        // flush_stat_pipeline() would drop it after the stat
+                    }
+                    else if (++dir_entries > SPLITDIR_ENTRIES)
                     {
-                        // full-path is <path> + "/" + readdir()
-                        PathPtr p_new = PathFactory::create(path);
-                        if (!p_new->exists())
+                        memset(&splitbuffer[split_count], 0, sizeof(path_item));
+                        strncpy(splitbuffer[split_count].path, path, PATHSIZE_PLUS);
+                        splitbuffer[split_count].start = START_SPLIT;
+                        split_count++;
+                        if (split_count == SPLITDIR_BATCH)
                         {
-                            // GRANSOM EDIT : Altered to make 'stat' failure NONFATAL, even if o.work_type != LSWORK
-                            errsend_fmt( NONFATAL, "Failed to stat path (2) '%s'\n", p_new->path() );
-                            break; // why would we return here if doing LSWORK? Live lock if we just return...
-                            if (o.work_type == LSWORK)
-                                return;
+                            send_manager_dirs_buffer(splitbuffer, &split_count);
                         }
-
-                        if(!S_ISREG(p_new->mode()) && !S_ISDIR(p_new->mode()) && !S_ISLNK(p_new->mode()))
+                    }
+                    else
+                    {
+                        // full-path is <path> + "/" + name.  A failed
+                        // stat ends this directory.  (Why would we return
+                        // here if doing LSWORK? Live lock if we just return...)
+                        path_item *entry = push_stat_pipeline(&pending, path, 0, p_work.get(), path_len);
+
+                        // A plain listing only needs to know a directory
+                        // is one; opendir() will stat it anyway.
+                        if ((ent->type == DT_DIR) && (o.work_type == LSWORK) && (o.verbose <= 1))
                         {
-                            continue;
+                            entry->st.st_mode = S_IFDIR;
+                            entry->ftype = REGULARFILE; // as stat_entry() would
+                            entry->dest_ftype = REGULARFILE;
                         }
-
-                        workbuffer[buffer_count] = p_new->node();
-                        buffer_count++;
-                        if (buffer_count != 0 && buffer_count % STATBUFFER == 0)
+                        if ((pending.count == STAT_PIPELINE) &&
+                            !flush_stat_pipeline(&pending, workbuffer, &buffer_count, &buffer_since, base_path, dest_node, o, rank))
                         {
-                            process_stat_buffer(workbuffer, &buffer_count, base_path, dest_node, o, rank);
+                            dir_done = true;
+                            break;
                         }
                     }
                 }
             }
+            if (pending.count)
+            {
+                flush_stat_pipeline(&pending, workbuffer, &buffer_count, &buffer_since, base_path, dest_node, o, rank);
+            }
 
-            // did the readdir() loop exit because of an error?
-            if (!readdir_p)
+            if (split_count)
+            {
+                send_manager_dirs_buffer(splitbuffer, &split_count);
+            }
+
+            // did the readdir_batch() loop exit because of an error?
+            if (!dir_done && !readdir_p)
             {
                 errsend_fmt(NONFATAL, "readdir (entry %d) failed on '%s' (%s)\n",
                             buffer_count, work_node.path, p_work->strerror());
@@ -2197,16 +2870,104 @@ void worker_readdir(int rank,
         }
     }
 
+    if (pending.count)
+    {
+        flush_stat_pipeline(&pending, workbuffer, &buffer_count, &buffer_since, base_path, dest_node, o, rank);
+    }
+
     // process any remaining partially-filled workbuffer contents
     while (buffer_count != 0)
     {
         process_stat_buffer(workbuffer, &buffer_count, base_path, dest_node, o, rank);
     }
 
-    free(workbuf);
+    free(dirent_buf);
     send_manager_work_done(rank);
 }
 
+// With '-B', process_stat_buffer() learns which destination files exist
+// from one listing of their directory, instead of a stat per file.  Only
+// the names that are there get stat'ed, relative to the open directory (see
+// Path::stat_entry()).  A big source directory arrives in many stat
+// buffers, so the listing is kept for the next one.  Names this job creates
+// in the meantime belong to other source files, so they don't matter.
+static char listed_dir[PATHSIZE_PLUS] = {0}; // directory in <listed_names>
+static int listed_ok = 0;                    // <listed_names> is usable
+static std::set<std::string> listed_names;
+
+// read all the names in <p_dir> (already open) into <listed_names>
+static int read_dest_listing(PathPtr &p_dir)
+{
+    std::vector<DirEntry> entries;
+    char *buf = (char *)malloc(DIRENT_BUFSIZE);
+    int ok = 0;
+
+    if (!buf)
+    {
+        errsend_fmt(FATAL, "Failed to allocate %d bytes for directory entries\n", DIRENT_BUFSIZE);
+    }
+    while (p_dir->readdir_batch(entries, buf, DIRENT_BUFSIZE))
+    {
+        if (entries.empty())
+        {
+            ok = 1; // EOF
+            break;
+        }
+        for (std::vector<DirEntry>::const_iterator ent = entries.begin(); ent != entries.end(); ++ent)
+        {
+            listed_names.insert(ent->name);
+        }
+    }
+    free(buf);
+    return ok;
+}
+
+// Fill in the stat of <out_node> from the listing of its directory, which
+// <p_dir> holds open for the rest of the stat buffer.  Returns 1 if it
+// exists, 0 if not, or -1 if the listing can't tell (not POSIX, or
+// unreadable), and the caller should stat it as usual.
+static int lookup_dest_listing(path_item *out_node, PathPtr &p_dir)
+{
+    char *name = strrchr(out_node->path, '/');
+    char dir[PATHSIZE_PLUS];
+
+    if (!name || (name == out_node->path))
+    {
+        return -1;
+    }
+    memcpy(dir, out_node->path, name - out_node->path);
+    dir[name - out_node->path] = 0;
+    name++;
+
+    if (strcmp(dir, listed_dir))
+    {
+        // a new directory: list it
+        strncpy(listed_dir, dir, PATHSIZE_PLUS);
+        listed_names.clear();
+        p_dir = PathFactory::create(dir);
+        listed_ok = (!strcmp(p_dir->class_name().get(), "POSIX_Path") && p_dir->opendir() && read_dest_listing(p_dir));
+    }
+    else if (listed_ok && (!p_dir || strcmp(p_dir->path(), dir)))
+    {
+        // listed for an earlier buffer; open it, for stat_entry()
+        p_dir = PathFactory::create(dir);
+        listed_ok = p_dir->opendir();
+    }
+    if (!listed_ok)
+    {
+        return -1;
+    }
+
+    out_node->ftype = REGULARFILE; // as stat_item() would
+    out_node->dest_ftype = REGULARFILE;
+    if (!listed_names.count(name) || !p_dir->stat_entry(name, out_node))
+    {
+        memset(&out_node->st, 0, sizeof(struct stat));
+        return 0;
+    }
+    return 1;
+}
+
 // helper for process_stat_buffer() avoids duplicated code
 //
 // This is called once only (per destination), before any copies are
@@ -2506,10 +3267,6 @@ void process_stat_buffer(path_item *path_buffer,
 {
 
     //When a worker is told to stat, it comes here
-    int out_position;
-    char *writebuf;
-    int writesize;
-    int write_count = 0;
     int num_examined_files = 0;
     size_t num_examined_bytes = 0;
     size_t num_finished_bytes = 0;
@@ -2529,6 +3286,8 @@ void process_stat_buffer(path_item *path_buffer,
     int dest_exists = 0;    // the destination already exists?
     int dest_has_ctm = -1;  // -1=unsure, 0=no, 1=yes
     int dest_has_temp = -1; // -1=unsure, 0=no, 1=yes
+    int listed;             // from lookup_dest_listing()
+    PathPtr p_listed_dir;   // open for lookup_dest_listing()
 
     struct tm sttm;
     char modebuf[15] = {0};
@@ -2553,18 +3312,12 @@ void process_stat_buffer(path_item *path_buffer,
     int dir_buffer_count = 0;
     path_item regbuffer[COPYBUFFER] = {0};
     int reg_buffer_count = 0;
-
-    writesize = MESSAGESIZE * MESSAGEBUFFER;
-    writebuf = (char *)malloc(writesize * sizeof(char));
-    if (!writebuf)
-    {
-        errsend_fmt(FATAL, "Failed to allocate %lu bytes for writebuf\n", writesize);
-    }
+    double dir_since = MPI_Wtime(); // for batch_ready()
+    double reg_since = dir_since;
 
     //sort path_buffer by mtime
     std::sort(path_buffer, path_buffer + *stat_count, compare);
 
-    out_position = 0;
     for (i = 0; i < *stat_count; i++)
     {
         process = 0;
@@ -2588,7 +3341,6 @@ void process_stat_buffer(path_item *path_buffer,
         // We will not have a dest in list so we will not check
         if ((o.work_type != LSWORK) && p_work->identical(p_dest))
         {
-            write_count--;
             continue;
         }
 
@@ -2597,13 +3349,20 @@ void process_stat_buffer(path_item *path_buffer,
         {
             dirbuffer[dir_buffer_count] = p_work->node(); //// work_node;
             dir_buffer_count++;
-            if (dir_buffer_count % DIRBUFFER == 0)
+            if (batch_ready(BATCH_DIRS, dir_buffer_count, dir_since))
             {
                 send_manager_dirs_buffer(dirbuffer, &dir_buffer_count);
+                dir_since = MPI_Wtime();
             }
             num_examined_dirs++;
         }
 
+        // unchanged since an earlier run found it in sync (see '-I')
+        else if (o.snapshot_dir[0] && snapshot_unchanged(&work_node, &out_node, base_path, dest_node, o))
+        {
+            num_finished_bytes += work_node.st.st_size;
+        }
+
         else
         {
             //it's not a directory
@@ -2614,14 +3373,18 @@ void process_stat_buffer(path_item *path_buffer,
             // --- (1) install coded-value into <dest_exists>, interpreted in (2)
 
             get_output_path(&out_node, base_path, &work_node, dest_node, o, 0);
+            listed = (o.dest_listing ? lookup_dest_listing(&out_node, p_listed_dir) : -1);
             p_out = PathFactory::create_shallow(&out_node);
-            p_out->stat();
+            if (listed < 0)
+            {
+                p_out->stat();
+            }
 
             //   0 = nope
             //   1 = exists
             //   *  (in the case of COPYWORK, see below)
             //
-            dest_exists = p_out->exists(); // boolean
+            dest_exists = ((listed < 0) ? p_out->exists() : listed); // boolean
 
             // if selected options require writing to a temp-file, instead of
             // dest, then determine whether it exists. (We also check whether
@@ -2733,6 +3496,7 @@ void process_stat_buffer(path_item *path_buffer,
 
                     process = 0; // source/dest are the same, so skip
                     num_finished_bytes += work_node.st.st_size;
+                    snapshot_record(&work_node, out_node.path);
                     // printf("  samefile\n");
                 }
 
@@ -2957,6 +3721,23 @@ void process_stat_buffer(path_item *path_buffer,
                                       p_out->path());
                         }
 
+                        // count the chunks we'll queue, so the manager knows
+                        // when it has handed out the last one ('-N local')
+                        work_node.chkcnt = 0;
+                        if (((size_t)work_node.st.st_size > chunk_at) && !S_ISLNK(work_node.st.st_mode) &&
+                            !(o.work_type == COMPAREWORK && o.meta_data_only))
+                        {
+                            size_t chksz = ((ctm) ? ctm->chnksz : chunk_size);
+                            long nchunks = (work_node.st.st_size + chksz - 1) / chksz;
+                            for (idx = 0; idx < nchunks; idx++)
+                            {
+                                if (!o.different || !chunktransferredCTM(ctm, idx))
+                                {
+                                    work_node.chkcnt++;
+                                }
+                            }
+                        }
+
                         // --- CHUNKING-LOOP
                         idx = 0;               // keeps track of the chunk index
                         chunk_curr_offset = 0; // keeps track of current offset in file for chunk.
@@ -2989,12 +3770,10 @@ void process_stat_buffer(path_item *path_buffer,
                             if (!o.different || !chunktransferredCTM(ctm, work_node.chkidx))
                             {
 
-                                // if we have hit the size of a COPYBUFFER or are about to exceed chunk_size, ship off the work
-                                if ( reg_buffer_count != 0  &&
-                                     (
-                                      ((reg_buffer_count % COPYBUFFER) == 0) || 
-                                      ((num_bytes_seen + work_node.chksz) > chunk_size)
-                                     )
+                                // if we have a full batch or are about to exceed chunk_size, ship off the work
+                                if ( batch_ready(BATCH_COPIES, reg_buffer_count, reg_since) ||
+                                     ( reg_buffer_count != 0  &&
+                                       ((num_bytes_seen + work_node.chksz) > chunk_size) )
                                    )
                                 {
                                     PRINT_MPI_DEBUG("rank %d: process_stat_buffer() parallel destination "
@@ -3002,6 +3781,7 @@ void process_stat_buffer(path_item *path_buffer,
                                                     rank, reg_buffer_count);
                                     send_manager_regs_buffer(regbuffer, &reg_buffer_count);
                                     num_bytes_seen = 0;
+                                    reg_since = MPI_Wtime();
                                 }
 
                                 num_bytes_seen += work_node.chksz;       // keep track of number of bytes processed
@@ -3040,14 +3820,16 @@ void process_stat_buffer(path_item *path_buffer,
                     }
                     else
                     {
-                        // if we have hit the size of a COPYBUFFER or are about to exceed SHIPOFF size, send the work-package now
-                        if (reg_buffer_count % COPYBUFFER == 0 || (reg_buffer_count != 0 && (num_bytes_seen + work_node.st.st_size) > SHIPOFF))
+                        // if we have a full batch or are about to exceed the batch's bytes (SHIPOFF), send the work-package now
+                        if (batch_ready(BATCH_COPIES, reg_buffer_count, reg_since) ||
+                            (reg_buffer_count != 0 && (num_bytes_seen + work_node.st.st_size) > batch_limit(BATCH_BYTES)))
                         {
                             PRINT_MPI_DEBUG("rank %d: process_stat_buffer() non-parallel destination "
                                             "- sending %d reg buffers to manager.\n",
                                             rank, reg_buffer_count);
                             send_manager_regs_buffer(regbuffer, &reg_buffer_count);
                             num_bytes_seen = 0;
+                            reg_since = MPI_Wtime();
                         }
                         work_node.chkidx = 0;                   // for non-chunked files, index is always 0
                         work_node.chksz = work_node.st.st_size; // set chunk size to size of file
@@ -3076,43 +3858,21 @@ void process_stat_buffer(path_item *path_buffer,
                     modebuf, (long unsigned int)work_node.st.st_blocks,
                     work_node.st.st_uid, work_node.st.st_gid,
                     (size_t)work_node.st.st_size, timebuf, work_node.path);
-
-            MPI_Pack(statrecord, MESSAGESIZE, MPI_CHAR, writebuf, writesize, &out_position, MPI_COMM_WORLD);
-
-            write_count++;
-            if (write_count % MESSAGEBUFFER == 0)
-            {
-                write_buffer_output(writebuf, writesize, write_count);
-                out_position = 0;
-                write_count = 0;
-            }
+            write_output(statrecord, 0);
         }
 
         // regbuffer is full (probably with zero-length files) -> send it
         // off to manager. - cds 8/2015
-        if (reg_buffer_count >= COPYBUFFER)
+        if (batch_ready(BATCH_COPIES, reg_buffer_count, reg_since))
         {
             PRINT_MPI_DEBUG("rank %d: process_stat_buffer() sending %d reg "
                             "buffers to manager.\n",
                             rank, reg_buffer_count);
             send_manager_regs_buffer(regbuffer, &reg_buffer_count);
+            reg_since = MPI_Wtime();
         }
     } //end of stat processing loop
 
-    //incase we tried to copy a file into itself
-    if (0 < write_count && o.verbose >= 1)
-    {
-        writesize = MESSAGESIZE * write_count;
-        writebuf = (char *)realloc(writebuf, writesize * sizeof(char));
-        if (!writebuf)
-        {
-            errsend_fmt(FATAL,
-                        "Failed to re-allocate %lu bytes for writebuf, write_count: %d\n",
-                        writesize, write_count);
-        }
-        write_buffer_output(writebuf, writesize, write_count);
-    }
-
     while (dir_buffer_count != 0)
     {
         send_manager_dirs_buffer(dirbuffer, &dir_buffer_count);
@@ -3124,30 +3884,113 @@ void process_stat_buffer(path_item *path_buffer,
     }
 
     send_manager_examined_stats(num_examined_files, num_examined_bytes, num_examined_dirs, num_finished_bytes);
-    //free malloc buffers
-    free(writebuf);
     *stat_count = 0;
 }
 
+// The items of one COPYCMD/COMPARECMD buffer, unpacked, for copy_item() or
+// compare_item() to work on, perhaps on several threads at once (see
+// run_worker_threads()).  Each item only touches its own result.
+typedef struct item_job
+{
+    int rank;
+    const char *base_path;
+    path_item *dest_node;
+    struct options *o;
+    path_item *items;
+    int *rc; // copy_file() or compare_file() result, for each item
+} item_job;
+
+static void unpack_item_job(item_job *job, int rank, int sending_rank, const char *msg,
+                            const char *base_path, path_item *dest_node, struct options &o)
+{
+    int read_count = MSG_HDR(msg)->count;
+    path_batch_view view;
+    int i;
+
+    job->rank = rank;
+    job->base_path = base_path;
+    job->dest_node = dest_node;
+    job->o = &o;
+    job->items = (path_item *)malloc(read_count * sizeof(path_item));
+    job->rc = (int *)malloc(read_count * sizeof(int));
+    if ((read_count && !job->items) || (read_count && !job->rc))
+    {
+        errsend_fmt(FATAL, "Failed to allocate %lu bytes for %d items\n", read_count * sizeof(path_item), read_count);
+    }
+
+    PRINT_MPI_DEBUG("rank %d: unpack_item_job() Receiving the workbuf from %d\n", rank, sending_rank);
+    if (path_batch_view_init(&view, MSG_PAYLOAD(msg), MSG_HDR(msg)->payload_len) != read_count)
+    {
+        errsend_fmt(FATAL, "Expected %d items in message from rank %d\n", read_count, sending_rank);
+    }
+    for (i = 0; i < read_count; i++)
+    {
+        unpack_path_item(&job->items[i], &view, i);
+    }
+}
+
+static void free_item_job(item_job *job)
+{
+    free(job->items);
+    free(job->rc);
+}
+
+static void copy_item(void *arg, int i)
+{
+    item_job *job = (item_job *)arg;
+    struct options &o = *job->o;
+    path_item &work_node = job->items[i];
+    path_item out_node;
+    off_t offset;
+    size_t length;
+    int rc;
+
+    offset = work_node.chkidx * work_node.chksz;
+    length = (((offset + work_node.chksz) > work_node.st.st_size)
+                  ? (work_node.st.st_size - offset)
+                  : work_node.chksz);
+    PRINT_MPI_DEBUG("rank %d: copy_item() chunk %d unpacked. "
+                    "offset = %ld   length = %ld\n",
+                    job->rank, work_node.chkidx, offset, length);
+
+    get_output_path(&out_node, job->base_path, &work_node, job->dest_node, o, work_node.temp_flag);
+
+    // make sure destination filesystem type is assigned for copy - cds 6/2014
+    out_node.fstype = o.dest_fstype;
+
+    // Need Path objects for the copy_file at this point ...
+    PathPtr p_work(PathFactory::create_shallow(&work_node));
+    PathPtr p_out(PathFactory::create_shallow(&out_node));
+
+    rc = copy_file(p_work, p_out, o.blocksize, job->rank, o);
+    if ((rc >= 0) && (o.verbose >= 1))
+    {
+        if (S_ISLNK(work_node.st.st_mode))
+        {
+            output_fmt(0, "INFO  DATACOPY Created symlink '%s' from '%s'\n",
+                       out_node.path, work_node.path);
+        }
+        else
+        {
+            output_fmt(0, "INFO  DATACOPY %sCopied '%s' chunk %d offs %lld len %lld to '%s'\n",
+                       ((rc == 1) ? "*" : ""),
+                       work_node.path, work_node.chkidx, (long long)offset, (long long)length, out_node.path);
+        }
+    }
+    job->rc[i] = rc;
+}
+
 //When a worker is told to copy, it comes here
 void worker_copylist(int rank,
                      int sending_rank,
+                     const char *msg,
                      const char *base_path,
                      path_item *dest_node,
                      struct options &o)
 {
 
-    MPI_Status status;
-    char *workbuf;
-    char *writebuf;
-    int worksize;
-    int writesize;
-    int position;
-    int out_position;
     int read_count;
-    path_item work_node;
-    memset(&work_node, 0, sizeof(path_item));
-    path_item out_node;
+    item_job job;
     off_t offset;
     size_t length;
     int num_copied_files = 0;
@@ -3155,92 +3998,40 @@ void worker_copylist(int rank,
     path_item chunks_copied[CHUNKBUFFER];
     int buffer_count = 0;
     int i;
-    int rc;
 
     PRINT_MPI_DEBUG("rank %d: worker_copylist() Receiving the read_count from %d\n",
                     rank, sending_rank);
-    if (MPI_Recv(&read_count, 1, MPI_INT, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
-    {
-        errsend(FATAL, "Failed to receive read_count\n");
-    }
-
-    worksize = read_count * sizeof(path_list);
-    workbuf = (char *)malloc(worksize * sizeof(char));
-    if (!workbuf)
-    {
-        errsend_fmt(FATAL, "Failed to allocate %lu bytes for workbuf\n", worksize);
-    }
-
-    writesize = MESSAGESIZE * read_count;
-    writebuf = (char *)malloc(writesize * sizeof(char));
-    if (!writebuf)
-    {
-        errsend_fmt(FATAL, "Failed to allocate %lu bytes for writebuf\n", writesize);
-    }
+    read_count = MSG_HDR(msg)->count;
+    unpack_item_job(&job, rank, sending_rank, msg, base_path, dest_node, o);
 
-    //gather the path to stat
-    PRINT_MPI_DEBUG("rank %d: worker_copylist() Receiving the workbuf from %d\n",
-                    rank, sending_rank);
-    if (MPI_Recv(workbuf, worksize, MPI_PACKED, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
-    {
-        errsend(FATAL, "Failed to receive workbuf\n");
-    }
+    // with '-y', several at once
+    run_worker_threads(read_count, copy_item, &job);
 
-    position = 0;
-    out_position = 0;
     for (i = 0; i < read_count; i++)
     {
-        PRINT_MPI_DEBUG("rank %d: worker_copylist() unpacking work_node from %d\n",
-                        rank, sending_rank);
-        MPI_Unpack(workbuf, worksize, &position, &work_node, sizeof(path_item), MPI_CHAR, MPI_COMM_WORLD);
+        path_item &work_node = job.items[i];
+
+        if (job.rc[i] < 0)
+        {
+            continue;
+        }
         offset = work_node.chkidx * work_node.chksz;
         length = (((offset + work_node.chksz) > work_node.st.st_size)
                       ? (work_node.st.st_size - offset)
                       : work_node.chksz);
-        PRINT_MPI_DEBUG("rank %d: worker_copylist() chunk %d unpacked. "
-                        "offset = %ld   length = %ld\n",
-                        rank, work_node.chkidx, offset, length);
-
-        get_output_path(&out_node, base_path, &work_node, dest_node, o, work_node.temp_flag);
-
-        // make sure destination filesystem type is assigned for copy - cds 6/2014
-        out_node.fstype = o.dest_fstype;
-
-        // Need Path objects for the copy_file at this point ...
-        PathPtr p_work(PathFactory::create_shallow(&work_node));
-        PathPtr p_out(PathFactory::create_shallow(&out_node));
-
-        rc = copy_file(p_work, p_out, o.blocksize, rank, o);
-        if (rc >= 0)
+        num_copied_files += 1;
+        if (!S_ISLNK(work_node.st.st_mode))
         {
-            if (o.verbose >= 1)
-            {
-                if (S_ISLNK(work_node.st.st_mode))
-                {
-                    output_fmt(0, "INFO  DATACOPY Created symlink '%s' from '%s'\n",
-                               out_node.path, work_node.path);
-                }
-                else
-                {
-                    output_fmt(0, "INFO  DATACOPY %sCopied '%s' chunk %d offs %lld len %lld to '%s'\n",
-                               ((rc == 1) ? "*" : ""),
-                               work_node.path, work_node.chkidx, (long long)offset, (long long)length, out_node.path);
-                }
-                out_position = 0;
-            }
-            num_copied_files += 1;
-            if (!S_ISLNK(work_node.st.st_mode))
-            {
-                num_copied_bytes += length;
-            }
-            //file is chunked
-            if (offset != 0 || (offset == 0 && length != work_node.st.st_size))
-            {
-                chunks_copied[buffer_count] = work_node;
-                buffer_count++;
-            }
+            num_copied_bytes += length;
+        }
+        //file is chunked
+        if (offset != 0 || (offset == 0 && length != work_node.st.st_size))
+        {
+            chunks_copied[buffer_count] = work_node;
+            buffer_count++;
         }
     }
+    free_item_job(&job);
 
     //update the chunk information
     if (buffer_count > 0)
@@ -3254,133 +4045,98 @@ void worker_copylist(int rank,
         send_manager_copy_stats(num_copied_files, num_copied_bytes);
     }
     send_manager_work_done(rank);
-    free(workbuf);
-    free(writebuf);
 }
 
-//When a worker is told to compare, it comes here
-void worker_comparelist(int rank,
-                        int sending_rank,
-                        const char *base_path,
-                        path_item *dest_node,
-                        struct options &o)
+static void compare_item(void *arg, int i)
 {
-
-    MPI_Status status;
-    char *workbuf;
-    char *writebuf;
-    int worksize;
-    int writesize;
-    int position;
-    int out_position;
-    int read_count;
-    path_item work_node = {0};
+    item_job *job = (item_job *)arg;
+    struct options &o = *job->o;
+    path_item &work_node = job->items[i];
     path_item out_node = {0};
     char copymsg[MESSAGESIZE] = {0};
     off_t offset;
     size_t length;
-    int num_compared_files = 0;
-    size_t num_compared_bytes = 0;
-    path_item chunks_copied[CHUNKBUFFER] = {0};
-    int buffer_count = 0;
-    int i;
     int rc;
-    int output = 0; // did vebosity-level let us print anything?
 
-    PRINT_MPI_DEBUG("rank %d: worker_copylist() Receiving the read_count from %d\n", rank, sending_rank);
-    if (MPI_Recv(&read_count, 1, MPI_INT, sending_rank, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+    get_output_path(&out_node, job->base_path, &work_node, job->dest_node, o, 0);
+    stat_item(&out_node, o);
+    offset = work_node.chkidx * work_node.chksz;
+    length = work_node.chksz;
+
+    rc = compare_file(&work_node, &out_node, o.blocksize, o.meta_data_only, o);
+    if (o.meta_data_only || S_ISLNK(work_node.st.st_mode))
     {
-        errsend(FATAL, "Failed to receive read_count\n");
+        snprintf(copymsg, MESSAGESIZE,
+                 "INFO  DATACOMPARE compared '%s' to '%s'",
+                 work_node.path, out_node.path);
     }
-
-    worksize = read_count * sizeof(path_list);
-    workbuf = (char *)calloc(worksize, sizeof(char));
-    if (!workbuf)
+    else
     {
-        errsend_fmt(FATAL, "Failed to allocate %lu bytes for workbuf\n", worksize);
+        snprintf(copymsg, MESSAGESIZE,
+                 "INFO  DATACOMPARE compared '%s' offs %lld len %lld to '%s'",
+                 work_node.path, (long long)offset, (long long)length, out_node.path);
     }
 
-    writesize = MESSAGESIZE * read_count;
-    writebuf = (char *)calloc(writesize, sizeof(char));
-    if (!writebuf)
+    size_t msg_remain = MESSAGESIZE - strlen(copymsg);
+    if (rc == 0)
     {
-        errsend_fmt(FATAL, "Failed to allocate %lu bytes for writebuf\n", writesize);
+        strncat(copymsg, " -- SUCCESS\n", msg_remain);
     }
-
-    //gather the path to stat
-    PRINT_MPI_DEBUG("rank %d: worker_copylist() Receiving the workbuf from %d\n", rank, sending_rank);
-    if (MPI_Recv(workbuf, worksize, MPI_PACKED, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+    else if (rc == 2)
+    {
+        strncat(copymsg, " -- MISSING DESTINATION\n", msg_remain);
+        send_manager_nonfatal_inc();
+    }
+    else
     {
-        errsend(FATAL, "Failed to receive workbuf\n");
+        strncat(copymsg, " -- MISMATCH\n", msg_remain);
+        send_manager_nonfatal_inc();
     }
+    copymsg[MESSAGESIZE - 1] = 0;
 
-    position = 0;
-    out_position = 0;
-    for (i = 0; i < read_count; i++)
+    if ((rc != 0) || (o.verbose >= 1))
     {
-        PRINT_MPI_DEBUG("rank %d: worker_copylist() unpacking work_node from %d\n", rank, sending_rank);
-        MPI_Unpack(workbuf, worksize, &position, &work_node, sizeof(path_item), MPI_CHAR, MPI_COMM_WORLD);
+        write_output(copymsg, 0);
+    }
+    job->rc[i] = rc;
+}
 
-        get_output_path(&out_node, base_path, &work_node, dest_node, o, 0);
-        stat_item(&out_node, o);
-        offset = work_node.chkidx * work_node.chksz;
-        length = work_node.chksz;
+//When a worker is told to compare, it comes here
+void worker_comparelist(int rank,
+                        int sending_rank,
+                        const char *msg,
+                        const char *base_path,
+                        path_item *dest_node,
+                        struct options &o)
+{
 
-        rc = compare_file(&work_node, &out_node, o.blocksize, o.meta_data_only, o);
-        if (o.meta_data_only || S_ISLNK(work_node.st.st_mode))
-        {
-            snprintf(copymsg, MESSAGESIZE,
-                     "INFO  DATACOMPARE compared '%s' to '%s'",
-                     work_node.path, out_node.path);
-        }
-        else
-        {
-            snprintf(copymsg, MESSAGESIZE,
-                     "INFO  DATACOMPARE compared '%s' offs %lld len %lld to '%s'",
-                     work_node.path, (long long)offset, (long long)length, out_node.path);
-        }
+    int read_count;
+    item_job job;
+    size_t length;
+    int num_compared_files = 0;
+    size_t num_compared_bytes = 0;
+    int i;
 
-        size_t msg_remain = MESSAGESIZE - strlen(copymsg);
-        if (rc == 0)
-        {
-            strncat(copymsg, " -- SUCCESS\n", msg_remain);
-        }
-        else if (rc == 2)
-        {
-            strncat(copymsg, " -- MISSING DESTINATION\n", msg_remain);
-            send_manager_nonfatal_inc();
-        }
-        else
-        {
-            strncat(copymsg, " -- MISMATCH\n", msg_remain);
-            send_manager_nonfatal_inc();
-        }
-        copymsg[MESSAGESIZE - 1] = 0;
+    PRINT_MPI_DEBUG("rank %d: worker_comparelist() Receiving the read_count from %d\n", rank, sending_rank);
+    read_count = MSG_HDR(msg)->count;
+    unpack_item_job(&job, rank, sending_rank, msg, base_path, dest_node, o);
 
-        if ((rc != 0) || (o.verbose >= 1))
-        {
-            output = 1;
-            MPI_Pack(copymsg, MESSAGESIZE, MPI_CHAR, writebuf, writesize, &out_position, MPI_COMM_WORLD);
-        }
+    // with '-y', several at once
+    run_worker_threads(read_count, compare_item, &job);
+
+    for (i = 0; i < read_count; i++)
+    {
+        length = job.items[i].chksz;
 
-        // file is 'chunked'?
-        if (offset != 0 || length != work_node.st.st_size)
-        {
-            chunks_copied[buffer_count] = work_node;
-            buffer_count++;
-        }
         // always count files, we can use nonfatal errcount for the "files we would copy" message
         num_compared_files += 1;
 
         if (!o.meta_data_only) // always count bytes if doing a data compare
             num_compared_bytes += length;
-        else if (rc) // count bytes we could move in a copy job, otherwise don't increment
+        else if (job.rc[i]) // count bytes we could move in a copy job, otherwise don't increment
             num_compared_bytes += length;
     }
-    if (output)
-    {
-        write_buffer_output(writebuf, writesize, read_count);
-    }
+    free_item_job(&job);
 
     // Dont touch CTM for compare-work.  However, someday we may want to maintain
     // a distinct set of CTM to allow restarting comparisons.
@@ -3397,6 +4153,4 @@ void worker_comparelist(int rank,
         send_manager_copy_stats(num_compared_files, num_compared_bytes);
     }
     send_manager_work_done(rank);
-    free(workbuf);
-    free(writebuf);
 }
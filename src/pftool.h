@@ -21,26 +21,30 @@
 
 /* Function Prototypes */
 //manager rank operations
-int manager(int rank, struct options &o, int nproc, path_list *input_queue_head, path_list *input_queue_tail, int input_queue_count, const char *dest_path);
-void manager_workdone(int rank, int sending_rank, struct worker_proc_status *proc_status, int *free_rank_count, int *readdir_rank_count);
-int manager_add_paths(int rank, int sending_rank, path_list **queue_head, path_list **queue_tail, int *queue_count);
-void manager_add_buffs(int rank, int sending_rank, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize);
-void manager_add_copy_stats(int rank, int sending_rank, int *num_copied_files, size_t *num_copied_bytes);
-void manager_add_examined_stats(int rank, int sending_rank, int *num_examined_files, size_t *num_examined_bytes, int *num_examined_dirs, size_t *num_finished_bytes);
+int manager(int rank, struct options &o, int nproc, path_list *input_queue_head, path_list *input_queue_tail, int input_queue_count, const char *dest_path, const int *managers, const int *nodes);
+void manager_workdone(int rank, int sending_rank, const char *msg, worker_pool *workers);
+int manager_add_paths(int rank, int sending_rank, const char *msg, path_list **queue_head, path_list **queue_tail, int *queue_count);
+void manager_dispatch_process(struct options &o, worker_pool *workers, const dispatch_plan *plan, work_buf_heap *heap, work_buf_list **workbuflist, work_buf_list **workbuftail, work_buf_list **parkedlist, work_buf_list **parkedtail, int *workbufsize);
+void manager_dispatch_dirs(struct options &o, worker_pool *workers, const dispatch_plan *plan, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize, int *start);
+void manager_add_process_buffs(int rank, int sending_rank, char *msg, work_buf_heap *heap, int *workbufsize);
+void manager_add_buffs(int rank, int sending_rank, char *msg, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize);
+void manager_add_copy_stats(int rank, int sending_rank, const char *msg, int *num_copied_files, size_t *num_copied_bytes);
+void manager_add_examined_stats(int rank, int sending_rank, const char *msg, int *num_examined_files, size_t *num_examined_bytes, int *num_examined_dirs, size_t *num_finished_bytes);
 void send_manager_examined_stats(int num_examined_files, size_t num_examined_bytes, int num_examined_dirs);
+void sub_manager(int rank, struct options &o, int nproc, const int *managers, const int *nodes, wait_state *waiter);
 
 //worker rank operations
-void worker(int rank, struct options &o);
+void worker(int rank, struct options &o, const int *managers, const int *nodes);
 void worker_check_chunk(int rank, int sending_rank, HASHTBL **chunk_hash);
-void worker_flush_output(char *output_buffer, int *output_count);
-void worker_output(int rank, int sending_rank, int log, char *output_buffer, int *output_count, struct options &o);
-void worker_buffer_output(int rank, int sending_rank, char *output_buffer, int *output_count, struct options &o);
-void worker_update_chunk(int rank, int sending_rank, HASHTBL **chunk_hash, int *hash_count, const char *base_path, path_item *dest_node, struct options &o);
-void worker_readdir(int rank, int sending_rank, const char *base_path, path_item *dest_node, int start, int makedir, struct options &o);
+void worker_output(int rank, int sending_rank, const char *text, int log, struct options &o);
+void worker_buffer_output(int rank, int sending_rank, const char *msg, struct options &o);
+void worker_give_work(int rank, int sending_rank);
+void worker_update_chunk(int rank, int sending_rank, const char *msg, HASHTBL **chunk_hash, int *hash_count, const char *base_path, path_item *dest_node, struct options &o);
+void worker_readdir(int rank, int sending_rank, const char *msg, const char *base_path, path_item *dest_node, int start, int makedir, struct options &o);
 int stat_item(path_item *work_node, struct options &o);
 void process_stat_buffer(path_item *path_buffer, int *stat_count, const char *base_path, path_item *dest_node, struct options &o, int rank);
-void worker_copylist(int rank, int sending_rank, const char *base_path, path_item *dest_node, struct options &o);
-void worker_comparelist(int rank, int sending_rank, const char *base_path, path_item *dest_node, struct options &o);
+void worker_copylist(int rank, int sending_rank, const char *msg, const char *base_path, path_item *dest_node, struct options &o);
+void worker_comparelist(int rank, int sending_rank, const char *msg, const char *base_path, path_item *dest_node, struct options &o);
 
 #define NULL_DEVICE "/dev/null"
 #define WAIT_TIME 1
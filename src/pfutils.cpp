@@ -23,8 +23,11 @@
 #include <syslog.h>
 #include <signal.h>
 #include <math.h>
+#include <time.h> // clock_gettime()
+#include <sys/mman.h> // mmap(), for spilled work-buffers
 
-#include <pthread.h> // manager_sig_handler()
+#include <pthread.h> // manager_sig_handler(), run_worker_threads()
+#include <map> // place_homes
 
 // EXITCMD, or ctl-C
 volatile int worker_exit = 0;
@@ -62,6 +65,17 @@ void usage()
     printf(" [-v]         output verbosity [specify multiple times, to increase]\n");
     printf(" [-g]         debugging-level  [specify multiple times, to increase]\n");
     printf(" [-M]         The maximum number of readdir ranks, not limited if not specified (default \"-1\")\n");
+    printf(" [-Q]         how idle ranks wait for messages: { 0=spin | 1=backoff | 2=block }, default: 1\n");
+    printf(" [-k]         work-stealing: workers share out work among themselves, instead of via the manager (ignores -M)\n");
+    printf(" [-m]         memory for the manager's queued work, beyond which it spills to a scratch file (0 = no limit, default 1G)\n");
+    printf(" [-T]         scratch directory for the manager's spilled work (default $TMPDIR or /tmp)\n");
+    printf(" [-q]         dispatch policy: default, discovery, throughput, or ratio[:low:high] (copy-queue watermarks, default %d:%d)\n", DISPATCH_RATIO_LOW, DISPATCH_RATIO_HIGH);
+    printf(" [-N]         which free rank gets copy work: any, spread (to the least-busy node), or local (a file's chunks stay on one node)\n");
+    printf(" [-y]         threads per worker rank, to copy/compare several files (or chunks) of a buffer at once (default 1)\n");
+    printf(" [-H]         sub-managers: one rank per node feeds that node's workers, and reports to the manager (ignores -M)\n");
+    printf(" [-L]         directory for per-rank output logs (merge with pflogmerge), instead of stdout\n");
+    printf(" [-B]         list each destination directory once, instead of checking every destination file separately\n");
+    printf(" [-I]         directory for an index of files already in sync, so later '-n' copies can skip checking them\n");
     printf(" [-W]         Attempt O_DIRECT data writes if possible\n");
     printf(" [-R]         Attempt O_DIRECT data reads if possible\n");
     printf(" [-h]         print Usage information\n");
@@ -87,9 +101,9 @@ void usage()
 const char *cmd2str(OpCode cmdidx)
 {
     static const char *CMDSTR[] = {
-        "EXITCMD", "UPDCHUNKCMD", "BUFFEROUTCMD", "OUTCMD", "LOGCMD", "LOGONLYCMD", "COMPARECMD", "COPYCMD", "PROCESSCMD", "DIRCMD", "WORKDONECMD", "NONFATALINCCMD", "CHUNKBUSYCMD", "COPYSTATSCMD", "EXAMINEDSTATSCMD"};
+        "EXITCMD", "UPDCHUNKCMD", "BUFFEROUTCMD", "COMPARECMD", "COPYCMD", "PROCESSCMD", "INPUTCMD", "DIRCMD", "WORKDONECMD", "NONFATALINCCMD", "CHUNKBUSYCMD", "COPYSTATSCMD", "EXAMINEDSTATSCMD", "STEALCMD", "NOWORKCMD"};
 
-    return ((cmdidx > EXAMINEDSTATSCMD) ? "Invalid Command" : CMDSTR[cmdidx]);
+    return ((cmdidx > NOWORKCMD) ? "Invalid Command" : CMDSTR[cmdidx]);
 }
 
 // print the mode <aflag> into buffer <buf> in a regular 'pretty' format
@@ -1077,294 +1091,1273 @@ int request_response(int type_cmd)
 
 void send_command(int target_rank, int type_cmd, int mpi_tag)
 {
-#ifdef MPI_DEBUG
-    int rank;
-
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    PRINT_MPI_DEBUG("rank %d: Sending command %d to target rank %d\n", rank, type_cmd, target_rank);
-#endif
-
     // Send a simple CMD (without args) to a rank
-    if (MPI_Send(&type_cmd, 1, MPI_INT, target_rank, mpi_tag, MPI_COMM_WORLD) != MPI_SUCCESS)
+    send_message(target_rank, type_cmd, 0, NULL, 0, mpi_tag);
+}
+
+// Send <type_cmd>, with a copy of <payload>, as one message (see msg_hdr).
+void send_message(int target_rank, int type_cmd, int count, const void *payload, int payload_len, int mpi_tag)
+{
+    char *msg = (char *)malloc(sizeof(msg_hdr) + payload_len);
+    if (!msg)
     {
-        fprintf(stderr, "Failed to send command %d to rank %d\n", type_cmd, target_rank);
+        fprintf(stderr, "Failed to allocate %lu bytes for msg\n", sizeof(msg_hdr) + payload_len);
         MPI_Abort(MPI_COMM_WORLD, -1);
     }
+    MSG_HDR(msg)->opcode = type_cmd;
+    MSG_HDR(msg)->count = count;
+    MSG_HDR(msg)->payload_len = payload_len;
+    MSG_HDR(msg)->batch_level = 0;
+    if (payload_len)
+    {
+        memcpy(MSG_PAYLOAD(msg), payload, payload_len);
+    }
+    send_message_async(target_rank, msg, mpi_tag);
 }
 
-void send_path_buffer(int target_rank, int command, path_item *buffer, int *buffer_count)
+// With '-y', a worker rank runs the items of each copy/compare buffer on a
+// pool of threads.  MPI is initialized with MPI_THREAD_FUNNELED, so only
+// the main thread may call MPI.  Output, errors and messages from the pool
+// threads are queued here instead, in order, and the main thread sends
+// them on while it waits for the items to finish.  (See run_worker_threads())
+enum FunnelKind
 {
-    int i;
-    int position = 0;
-    int worksize;
-    char *workbuf;
-    path_item work_node;
-    path_item *work_node_ptr; /* avoid unnecessary copying */
+    FUNNEL_OUTPUT, // write_output(<data>, <arg>)
+    FUNNEL_ERROR,  // errsend_internal(<arg>, <data>)
+    FUNNEL_SEND    // send_message_async(<arg>, <data>, <tag>)
+};
 
-    worksize = *buffer_count * sizeof(path_item);
-    workbuf = (char *)malloc(worksize * sizeof(char));
-    if (!workbuf)
-    {
-        fprintf(stderr, "Failed to allocate %lu bytes for workbuf\n", worksize);
-        MPI_Abort(MPI_COMM_WORLD, -1);
-    }
-    for (i = 0; i < *buffer_count; i++)
+typedef struct funnel_rec
+{
+    struct funnel_rec *next;
+    int kind; // FunnelKind
+    int arg;
+    int tag;
+    char *data; // malloc'ed
+} funnel_rec;
+
+static __thread int on_pool_thread = 0;
+static pthread_mutex_t funnel_lock = PTHREAD_MUTEX_INITIALIZER; // everything below
+static pthread_cond_t funnel_cond = PTHREAD_COND_INITIALIZER;   // main thread waits here
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;     // pool threads wait here
+static funnel_rec *funnel_head = NULL;
+static funnel_rec *funnel_tail = NULL;
+static pthread_t *pool_threads = NULL;
+static int pool_nthreads = 0;
+static struct
+{
+    void (*fn)(void *arg, int index); // NULL: the threads should exit
+    void *arg;
+    int count;
+    int next; // next index to hand out
+    int done; // indices finished
+    long gen; // bumped for each new job
+} pool_job;
+
+static void errsend_internal(Lethality fatal, const char *errormsg);
+
+// Queue something for the main thread.  Takes ownership of <data>.
+static void funnel_push(int kind, int arg, int tag, char *data)
+{
+    funnel_rec *rec = (funnel_rec *)malloc(sizeof(funnel_rec));
+    if (!rec || !data)
     {
-        work_node_ptr = &buffer[i];
-        MPI_Pack(work_node_ptr, sizeof(path_item), MPI_CHAR, workbuf, worksize, &position, MPI_COMM_WORLD);
+        fprintf(stderr, "Failed to allocate %lu bytes for funnel_rec\n", sizeof(funnel_rec));
+        abort();
     }
-    send_command(target_rank, command, MPI_TAG_MORE_WORK);
-    if (MPI_Send(buffer_count, 1, MPI_INT, target_rank, MPI_TAG_MORE_WORK, MPI_COMM_WORLD) != MPI_SUCCESS)
+    rec->next = NULL;
+    rec->kind = kind;
+    rec->arg = arg;
+    rec->tag = tag;
+    rec->data = data;
+    pthread_mutex_lock(&funnel_lock);
+    if (funnel_tail)
     {
-        fprintf(stderr, "Failed to send buffer_count %d to rank %d\n", *buffer_count, target_rank);
-        MPI_Abort(MPI_COMM_WORLD, -1);
+        funnel_tail->next = rec;
     }
-    if (MPI_Send(workbuf, worksize, MPI_PACKED, target_rank, MPI_TAG_MORE_WORK, MPI_COMM_WORLD) != MPI_SUCCESS)
+    else
     {
-        fprintf(stderr, "Failed to send workbuf to rank %d\n", target_rank);
-        MPI_Abort(MPI_COMM_WORLD, -1);
+        funnel_head = rec;
     }
-    *buffer_count = 0;
-    free(workbuf);
+    funnel_tail = rec;
+    pthread_cond_signal(&funnel_cond);
+    pthread_mutex_unlock(&funnel_lock);
 }
 
-void send_buffer_list(int target_rank, int command, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize)
+// Main thread: send on everything queued by funnel_push().  Called with
+// <funnel_lock> held, which is dropped while sending.
+static void funnel_drain()
 {
-    int size = (*workbuflist)->size;
-    int worksize = sizeof(path_item) * size;
-    send_command(target_rank, command, MPI_TAG_NOT_MORE_WORK);
-    if (MPI_Send(&size, 1, MPI_INT, target_rank, MPI_TAG_NOT_MORE_WORK, MPI_COMM_WORLD) != MPI_SUCCESS)
+    funnel_rec *rec;
+
+    while ((rec = funnel_head))
     {
-        fprintf(stderr, "Failed to send workbuflist size %d to rank %d\n", size, target_rank);
-        MPI_Abort(MPI_COMM_WORLD, -1);
+        funnel_head = NULL;
+        funnel_tail = NULL;
+        pthread_mutex_unlock(&funnel_lock);
+        while (rec)
+        {
+            funnel_rec *next = rec->next;
+            switch (rec->kind)
+            {
+            case FUNNEL_OUTPUT:
+                write_output(rec->data, rec->arg);
+                free(rec->data);
+                break;
+            case FUNNEL_ERROR:
+                errsend_internal((Lethality)rec->arg, rec->data);
+                free(rec->data);
+                break;
+            case FUNNEL_SEND:
+                send_message_async(rec->arg, rec->data, rec->tag); // now owned by the send pool
+                break;
+            }
+            free(rec);
+            rec = next;
+        }
+        pthread_mutex_lock(&funnel_lock);
     }
-    if (MPI_Send((*workbuflist)->buf, worksize, MPI_PACKED, target_rank, MPI_TAG_NOT_MORE_WORK, MPI_COMM_WORLD) != MPI_SUCCESS)
+}
+
+static void *pool_thread_main(void *unused)
+{
+    long gen = 0;
+    int index;
+
+    on_pool_thread = 1;
+    pthread_mutex_lock(&funnel_lock);
+    while (1)
     {
-        fprintf(stderr, "Failed to send workbuflist buf to rank %d\n", target_rank);
-        MPI_Abort(MPI_COMM_WORLD, -1);
+        while (pool_job.gen == gen)
+        {
+            pthread_cond_wait(&pool_cond, &funnel_lock);
+        }
+        gen = pool_job.gen;
+        if (!pool_job.fn)
+        {
+            break;
+        }
+        while (pool_job.next < pool_job.count)
+        {
+            index = pool_job.next++;
+            pthread_mutex_unlock(&funnel_lock);
+            pool_job.fn(pool_job.arg, index);
+            pthread_mutex_lock(&funnel_lock);
+            if (++pool_job.done == pool_job.count)
+            {
+                pthread_cond_signal(&funnel_cond);
+            }
+        }
     }
-    dequeue_buf_list(workbuflist, workbuftail, workbufsize);
+    pthread_mutex_unlock(&funnel_lock);
+    return NULL;
 }
 
-//manager
-void send_manager_nonfatal_inc()
+// Start <count> pool threads for run_worker_threads().  With fewer than two,
+// items just run on the main thread.
+void start_worker_threads(int count)
 {
-    send_command(MANAGER_PROC, NONFATALINCCMD, MPI_TAG_NOT_MORE_WORK);
+    int i;
+
+    if (count < 2)
+    {
+        return;
+    }
+    pool_threads = (pthread_t *)malloc(count * sizeof(pthread_t));
+    if (!pool_threads)
+    {
+        errsend_fmt(FATAL, "Failed to allocate %lu bytes for pool_threads\n", count * sizeof(pthread_t));
+    }
+    for (i = 0; i < count; i++)
+    {
+        if (pthread_create(&pool_threads[i], NULL, pool_thread_main, NULL))
+        {
+            errsend_fmt(FATAL, "Failed to start worker thread %d: %s\n", i, strerror(errno));
+        }
+    }
+    pool_nthreads = count;
 }
 
-void send_manager_chunk_busy()
+void stop_worker_threads()
 {
-    send_command(MANAGER_PROC, CHUNKBUSYCMD, MPI_TAG_NOT_MORE_WORK);
+    int i;
+
+    if (!pool_nthreads)
+    {
+        return;
+    }
+    pthread_mutex_lock(&funnel_lock);
+    pool_job.fn = NULL;
+    pool_job.gen += 1;
+    pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&funnel_lock);
+    for (i = 0; i < pool_nthreads; i++)
+    {
+        pthread_join(pool_threads[i], NULL);
+    }
+    free(pool_threads);
+    pool_threads = NULL;
+    pool_nthreads = 0;
 }
 
-void send_manager_copy_stats(int num_copied_files, size_t num_copied_bytes)
+// Call <fn>(<arg>, i) for every i in [0, <count>), on the pool threads, and
+// return when they're all done.  <fn> may use write_output(), errsend(),
+// send_message(), etc. but nothing else that touches MPI.
+void run_worker_threads(int count, void (*fn)(void *arg, int index), void *arg)
 {
-    send_command(MANAGER_PROC, COPYSTATSCMD, MPI_TAG_NOT_MORE_WORK);
-    //send the # of paths
-    if (MPI_Send(&num_copied_files, 1, MPI_INT, MANAGER_PROC, MPI_TAG_NOT_MORE_WORK, MPI_COMM_WORLD) != MPI_SUCCESS)
+    int i;
+
+    if (!pool_nthreads || (count < 2))
     {
-        fprintf(stderr, "Failed to send num_copied_files %d to rank %d\n", num_copied_files, MANAGER_PROC);
-        MPI_Abort(MPI_COMM_WORLD, -1);
+        for (i = 0; i < count; i++)
+        {
+            fn(arg, i);
+        }
+        return;
     }
-    //send the # of paths
-    if (MPI_Send(&num_copied_bytes, 1, MPI_DOUBLE, MANAGER_PROC, MPI_TAG_NOT_MORE_WORK, MPI_COMM_WORLD) != MPI_SUCCESS)
+    pthread_mutex_lock(&funnel_lock);
+    pool_job.fn = fn;
+    pool_job.arg = arg;
+    pool_job.count = count;
+    pool_job.next = 0;
+    pool_job.done = 0;
+    pool_job.gen += 1;
+    pthread_cond_broadcast(&pool_cond);
+    while (1)
     {
-        fprintf(stderr, "Failed to send num_copied_byes %zd to rank %d\n", num_copied_bytes, MANAGER_PROC);
-        MPI_Abort(MPI_COMM_WORLD, -1);
+        funnel_drain();
+        if (pool_job.done == count)
+        {
+            break;
+        }
+        pthread_cond_wait(&funnel_cond, &funnel_lock);
     }
+    pthread_mutex_unlock(&funnel_lock);
 }
 
-void send_manager_examined_stats(int num_examined_files, size_t num_examined_bytes, int num_examined_dirs, size_t num_finished_bytes)
+// Outstanding non-blocking sends.  A message handed to send_message_async()
+// belongs to this pool until its MPI_Isend completes, and is then freed.
+// Slots with MPI_REQUEST_NULL are free.
+static MPI_Request send_pool_req[SEND_POOL_SIZE];
+static char *send_pool_buf[SEND_POOL_SIZE];
+static int send_pool_pending = -1; // -1 means not yet initialized
+
+static void send_pool_release(int slot)
+{
+    free(send_pool_buf[slot]);
+    send_pool_buf[slot] = NULL;
+    send_pool_pending--;
+}
+
+// Send a message whose header and payload the caller has already filled
+// in.  Ownership of <msg> (which must come from malloc) passes to the send
+// pool, so the caller can get on with its work while the send drains.  If
+// all SEND_POOL_SIZE slots are busy, we wait for one to complete.
+//
+// MPI doesn't let messages overtake each other between the same pair of
+// ranks with the same tag, so posting order is still delivery order.
+void send_message_async(int target_rank, char *msg, int mpi_tag)
 {
-    send_command(MANAGER_PROC, EXAMINEDSTATSCMD, MPI_TAG_NOT_MORE_WORK);
-    //send the # of paths
-    if (MPI_Send(&num_examined_files, 1, MPI_INT, MANAGER_PROC, MPI_TAG_NOT_MORE_WORK, MPI_COMM_WORLD) != MPI_SUCCESS)
+    int type_cmd = MSG_HDR(msg)->opcode;
+    int msgsize = sizeof(msg_hdr) + MSG_HDR(msg)->payload_len;
+    int slot;
+
+    if (on_pool_thread)
     {
-        fprintf(stderr, "Failed to send num_examined_files %d to rank %d\n", num_examined_files, MANAGER_PROC);
-        MPI_Abort(MPI_COMM_WORLD, -1);
+        funnel_push(FUNNEL_SEND, target_rank, mpi_tag, msg);
+        return;
     }
-    if (MPI_Send(&num_examined_bytes, 1, MPI_DOUBLE, MANAGER_PROC, MPI_TAG_NOT_MORE_WORK, MPI_COMM_WORLD) != MPI_SUCCESS)
+
+#ifdef MPI_DEBUG
+    int rank;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    PRINT_MPI_DEBUG("rank %d: Sending command %d (%d bytes) to target rank %d\n", rank, type_cmd, msgsize, target_rank);
+#endif
+
+    if (send_pool_pending < 0)
     {
-        fprintf(stderr, "Failed to send num_examined_bytes %zd to rank %d\n", num_examined_bytes, MANAGER_PROC);
-        MPI_Abort(MPI_COMM_WORLD, -1);
+        for (slot = 0; slot < SEND_POOL_SIZE; slot++)
+        {
+            send_pool_req[slot] = MPI_REQUEST_NULL;
+            send_pool_buf[slot] = NULL;
+        }
+        send_pool_pending = 0;
     }
-    if (MPI_Send(&num_examined_dirs, 1, MPI_INT, MANAGER_PROC, MPI_TAG_NOT_MORE_WORK, MPI_COMM_WORLD) != MPI_SUCCESS)
+
+    progress_sends();
+    for (slot = 0; (slot < SEND_POOL_SIZE) && (send_pool_req[slot] != MPI_REQUEST_NULL); slot++)
+        ;
+    if (slot == SEND_POOL_SIZE)
     {
-        fprintf(stderr, "Failed to send num_examined_dirs %d to rank %d\n", num_examined_dirs, MANAGER_PROC);
-        MPI_Abort(MPI_COMM_WORLD, -1);
+        if (MPI_Waitany(SEND_POOL_SIZE, send_pool_req, &slot, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+        {
+            fprintf(stderr, "Failed waiting for a send-slot\n");
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        send_pool_release(slot);
     }
-    if (MPI_Send(&num_finished_bytes, 1, MPI_DOUBLE, MANAGER_PROC, MPI_TAG_NOT_MORE_WORK, MPI_COMM_WORLD) != MPI_SUCCESS)
+
+    if (MPI_Isend(msg, msgsize, MPI_BYTE, target_rank, mpi_tag, MPI_COMM_WORLD, &send_pool_req[slot]) != MPI_SUCCESS)
     {
-        fprintf(stderr, "Failed to send num_finished_bytes %zd to rank %d\n", num_finished_bytes, MANAGER_PROC);
+        fprintf(stderr, "Failed to send command %d to rank %d\n", type_cmd, target_rank);
         MPI_Abort(MPI_COMM_WORLD, -1);
     }
+    send_pool_buf[slot] = msg;
+    send_pool_pending++;
 }
 
-void send_manager_regs_buffer(path_item *buffer, int *buffer_count)
+// Free the buffers of any sends that have completed.  Returns the number of
+// sends still outstanding.  Call this from polling loops, so buffers don't
+// linger.
+int progress_sends()
 {
-    //sends a chunk of regular files to the manager
-    send_path_buffer(MANAGER_PROC, PROCESSCMD, buffer, buffer_count);
+    int indices[SEND_POOL_SIZE];
+    int outcount;
+    int i;
+
+    if (send_pool_pending <= 0)
+    {
+        return 0;
+    }
+    if (MPI_Testsome(SEND_POOL_SIZE, send_pool_req, &outcount, indices, MPI_STATUSES_IGNORE) != MPI_SUCCESS)
+    {
+        fprintf(stderr, "Failed to test outstanding sends\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    if (outcount != MPI_UNDEFINED)
+    {
+        for (i = 0; i < outcount; i++)
+        {
+            send_pool_release(indices[i]);
+        }
+    }
+    return send_pool_pending;
 }
 
-void send_manager_dirs_buffer(path_item *buffer, int *buffer_count)
+// Wait for all outstanding sends (and buffered output) to complete.  Needed
+// before a barrier, or MPI_Finalize(), so nothing we've sent is still in
+// flight.
+void drain_sends()
 {
-    //sends a chunk of regular files to the manager
-    send_path_buffer(MANAGER_PROC, DIRCMD, buffer, buffer_count);
+    int slot;
+
+    flush_output();
+    if (send_pool_pending <= 0)
+    {
+        return;
+    }
+    if (MPI_Waitall(SEND_POOL_SIZE, send_pool_req, MPI_STATUSES_IGNORE) != MPI_SUCCESS)
+    {
+        fprintf(stderr, "Failed to wait for outstanding sends\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    for (slot = 0; slot < SEND_POOL_SIZE; slot++)
+    {
+        if (send_pool_buf[slot])
+        {
+            send_pool_release(slot);
+        }
+    }
 }
 
-void send_manager_work_done(int ignored)
+void wait_init(wait_state *ws, int mode)
 {
-    //the worker is finished processing, notify the manager
-    send_command(MANAGER_PROC, WORKDONECMD, MPI_TAG_NOT_MORE_WORK);
+    memset(ws, 0, sizeof(wait_state));
+    ws->mode = mode;
+    ws->backoff = WAIT_BACKOFF_MIN;
 }
 
-//worker
-void update_chunk(path_item *buffer, int *buffer_count)
+static void flush_stale_output();
+
+static double cpu_seconds()
 {
-    send_path_buffer(ACCUM_PROC, UPDCHUNKCMD, buffer, buffer_count);
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
 }
 
-void write_output(const char *message, int log)
+// Check for an incoming message, waiting according to <ws>->mode if there
+// isn't one.  Returns non-zero if a message is ready (described by
+// <status>), or zero if the caller should go around its loop again.
+//
+// Only when the caller says <can_block> (i.e. nothing but a message could
+// give it something to do) do we wait at all: WAIT_BLOCK blocks, and
+// WAIT_BACKOFF sleeps, doubling the sleep on each empty poll.  Otherwise we
+// return straight after the probe, so the caller gets on with its work.
+// The time from the first empty poll until a message shows up is added to
+// <ws>->idle_wall/idle_cpu.
+int wait_for_message(wait_state *ws, int can_block, MPI_Status *status)
 {
-    //write a single line using the outputproc
-    //set the command type
-    if (log == 0)
+    int message_ready = 0;
+
+    flush_stale_output();
+    progress_sends();
+    if (MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &message_ready, status) != MPI_SUCCESS)
     {
-        send_command(OUTPUT_PROC, OUTCMD, MPI_TAG_NOT_MORE_WORK);
+        errsend(FATAL, "MPI_Iprobe failed\n");
     }
-    else if (log == 1)
+    if (!message_ready && !can_block)
     {
-        send_command(OUTPUT_PROC, LOGCMD, MPI_TAG_NOT_MORE_WORK);
+        ws->backoff = WAIT_BACKOFF_MIN;
+        return 0;
     }
-    else if (log == 2)
+    if (!message_ready)
     {
-        send_command(OUTPUT_PROC, LOGONLYCMD, MPI_TAG_NOT_MORE_WORK);
+        if (!ws->idle)
+        {
+            flush_output(); // nothing else to do, might as well
+            ws->idle = 1;
+            ws->idle_wall0 = MPI_Wtime();
+            ws->idle_cpu0 = cpu_seconds();
+        }
+        if (ws->mode == WAIT_BLOCK)
+        {
+            if (MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, status) != MPI_SUCCESS)
+            {
+                errsend(FATAL, "MPI_Probe failed\n");
+            }
+            message_ready = 1;
+        }
+        else if (ws->mode != WAIT_SPIN)
+        {
+            usleep(ws->backoff);
+            ws->backoff *= 2;
+            if (ws->backoff > WAIT_BACKOFF_MAX)
+            {
+                ws->backoff = WAIT_BACKOFF_MAX;
+            }
+        }
     }
-
-    //send the message
-    if (MPI_Send((void *)message, MESSAGESIZE, MPI_CHAR, OUTPUT_PROC, MPI_TAG_NOT_MORE_WORK, MPI_COMM_WORLD) != MPI_SUCCESS)
+    if (message_ready)
     {
-        fprintf(stderr, "Failed to message to rank %d\n", OUTPUT_PROC);
-        MPI_Abort(MPI_COMM_WORLD, -1);
+        ws->backoff = WAIT_BACKOFF_MIN;
+        if (ws->idle)
+        {
+            ws->idle = 0;
+            ws->idle_wall += MPI_Wtime() - ws->idle_wall0;
+            ws->idle_cpu += cpu_seconds() - ws->idle_cpu0;
+        }
     }
+    return message_ready;
 }
 
-// This allows caller to use inline formatting, without first snprintf() to
-// a local errmsg-buffer.  Like so:
-//
-//    output_fmt(1, "rank %d hello!", rank);
-//
-void output_fmt(int log, const char *format, ...)
+// print accumulated idle-time for this rank
+void report_idle(wait_state *ws, int rank)
 {
-    char msg[MESSAGESIZE] = {0};
-    va_list args;
-
-    va_start(args, format);
-    vsnprintf(msg, MESSAGESIZE, format, args);
-    va_end(args);
+    static const char *mode_name[] = {"spin", "backoff", "block"};
+    char msg[MESSAGESIZE];
 
-    // msg[MESSAGESIZE -1] = 0;  /* no need for this */
-    write_output(msg, log);
+    snprintf(msg, MESSAGESIZE, "INFO  IDLE     rank %d (%s): %.2f s idle, %.2f s CPU while idle\n",
+             rank, mode_name[ws->mode], ws->idle_wall, ws->idle_cpu);
+    if (rank == OUTPUT_PROC)
+    {
+        printf("RANK %3d: %s", rank, msg); // can't send to ourselves, on the way out
+        fflush(stdout);
+    }
+    else
+    {
+        write_output(msg, 0);
+    }
 }
 
-void write_buffer_output(char *buffer, int buffer_size, int buffer_count)
+// Receive one whole message from <source>/<mpi_tag> (wildcards allowed),
+// into a buffer of exactly the right size.  Caller frees the returned
+// buffer.  <status> tells who sent it.
+char *recv_message(int source, int mpi_tag, MPI_Status *status)
 {
+    char *msg;
+    int msgsize;
 
-    //write a buffer to the output proc
-    //set the command type
-    send_command(OUTPUT_PROC, BUFFEROUTCMD, MPI_TAG_NOT_MORE_WORK);
-
-    //send the size of the buffer
-    if (MPI_Send(&buffer_count, 1, MPI_INT, OUTPUT_PROC, MPI_TAG_NOT_MORE_WORK, MPI_COMM_WORLD) != MPI_SUCCESS)
+    if (MPI_Probe(source, mpi_tag, MPI_COMM_WORLD, status) != MPI_SUCCESS)
     {
-        fprintf(stderr, "Failed to buffer_count %d to rank %d\n", buffer_count, OUTPUT_PROC);
-        MPI_Abort(MPI_COMM_WORLD, -1);
+        errsend(FATAL, "Failed to probe for message\n");
     }
-    if (MPI_Send(buffer, buffer_size, MPI_PACKED, OUTPUT_PROC, MPI_TAG_NOT_MORE_WORK, MPI_COMM_WORLD) != MPI_SUCCESS)
+    MPI_Get_count(status, MPI_BYTE, &msgsize);
+    msg = (char *)malloc(msgsize);
+    if (!msg)
     {
-        fprintf(stderr, "Failed to message to rank %d\n", OUTPUT_PROC);
-        MPI_Abort(MPI_COMM_WORLD, -1);
+        errsend_fmt(FATAL, "Failed to allocate %d bytes for message\n", msgsize);
+    }
+    if (MPI_Recv(msg, msgsize, MPI_BYTE, status->MPI_SOURCE, status->MPI_TAG, MPI_COMM_WORLD, status) != MPI_SUCCESS)
+    {
+        errsend(FATAL, "Failed to receive message\n");
+    }
+    if ((msgsize < (int)sizeof(msg_hdr)) ||
+        (MSG_HDR(msg)->payload_len != msgsize - (int)sizeof(msg_hdr)) ||
+        (MSG_HDR(msg)->count < 0))
+    {
+        errsend_fmt(FATAL, "Malformed message (%d bytes) from rank %d\n", msgsize, status->MPI_SOURCE);
     }
+    return msg;
 }
 
-void send_worker_queue_count(int target_rank, int queue_count)
+// pack <buffer_count> path_items into a new <command> message
+static char *pack_path_message(int command, path_item *buffer, int buffer_count)
 {
-    if (MPI_Send(&queue_count, 1, MPI_INT, target_rank, MPI_TAG_NOT_MORE_WORK, MPI_COMM_WORLD) != MPI_SUCCESS)
+    int i;
+    int worksize;
+    char *msg;
+    const path_item **items;
+
+    items = (const path_item **)malloc(buffer_count * sizeof(path_item *));
+    if (!items && buffer_count)
     {
-        fprintf(stderr, "Failed to queue_count %d to rank %d\n", queue_count, target_rank);
+        fprintf(stderr, "Failed to allocate %lu bytes for items\n", buffer_count * sizeof(path_item *));
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    for (i = 0; i < buffer_count; i++)
+    {
+        items[i] = &buffer[i];
+    }
+    worksize = path_batch_size(items, buffer_count);
+    msg = (char *)malloc(sizeof(msg_hdr) + worksize);
+    if (!msg)
+    {
+        fprintf(stderr, "Failed to allocate %lu bytes for msg\n", sizeof(msg_hdr) + worksize);
         MPI_Abort(MPI_COMM_WORLD, -1);
     }
+    pack_path_batch(items, buffer_count, MSG_PAYLOAD(msg), worksize);
+    MSG_HDR(msg)->opcode = command;
+    MSG_HDR(msg)->count = buffer_count;
+    MSG_HDR(msg)->payload_len = worksize;
+    MSG_HDR(msg)->batch_level = 0;
+    free(items);
+    return msg;
 }
 
-void send_worker_readdir(int target_rank, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize)
+void send_path_buffer(int target_rank, int command, path_item *buffer, int *buffer_count)
 {
-    //send a worker a buffer list of paths to stat
-    send_buffer_list(target_rank, DIRCMD, workbuflist, workbuftail, workbufsize);
+    send_message_async(target_rank, pack_path_message(command, buffer, *buffer_count), MPI_TAG_MORE_WORK);
+    *buffer_count = 0;
 }
 
-void send_worker_copy_path(int target_rank, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize)
+// With work-stealing ('-k'), a worker queues the work it discovers here,
+// instead of sending it to the manager.  It does its own copy/compare work
+// first, then directories.  Thieves get directories first, because those
+// lead to more work.  See worker().
+static int local_work = 0;
+static int local_work_type;
+static int local_recurse;
+static work_buf_list *local_dirs = NULL;
+static work_buf_list *local_dirs_tail = NULL;
+static int local_dirs_size = 0;
+static work_buf_list *local_regs = NULL;
+static work_buf_list *local_regs_tail = NULL;
+static int local_regs_size = 0;
+static int local_created = 0; // buffers queued since the last WORKDONE
+
+void init_local_work(int work_type, int recurse)
 {
-    //send a worker a list buffers with paths to copy
-    send_buffer_list(target_rank, COPYCMD, workbuflist, workbuftail, workbufsize);
+    local_work = 1;
+    local_work_type = work_type;
+    local_recurse = recurse;
 }
 
-void send_worker_compare_path(int target_rank, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize)
+static void queue_local_work(int command, path_item *buffer, int *buffer_count)
 {
-    //send a worker a list buffers with paths to compare
-    send_buffer_list(target_rank, COMPARECMD, workbuflist, workbuftail, workbufsize);
-}
+    char *msg = pack_path_message(command, buffer, *buffer_count);
 
-void send_worker_exit(int target_rank)
-{
-    //order a rank to exit
-    send_command(target_rank, EXITCMD, MPI_TAG_NOT_MORE_WORK);
+    if (command == DIRCMD)
+    {
+        enqueue_buf_list(&local_dirs, &local_dirs_tail, &local_dirs_size, msg, *buffer_count, sizeof(msg_hdr) + MSG_HDR(msg)->payload_len);
+    }
+    else
+    {
+        enqueue_buf_list(&local_regs, &local_regs_tail, &local_regs_size, msg, *buffer_count, sizeof(msg_hdr) + MSG_HDR(msg)->payload_len);
+    }
+    local_created++;
+    *buffer_count = 0;
 }
 
-static void errsend_internal(Lethality fatal, const char *errormsg)
+// take the message off the head of a local queue
+static char *take_local_work(work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize)
 {
+    char *msg = (*workbuflist)->buf;
 
-    write_output(errormsg, 1);
+    (*workbuflist)->buf = NULL;
+    dequeue_buf_list(workbuflist, workbuftail, workbufsize);
+    return msg;
+}
 
-    if (fatal)
+// our own next piece of work, or NULL.  Caller frees.
+char *pop_local_work()
+{
+    if (local_regs_size > 0)
     {
-        MPI_Abort(MPI_COMM_WORLD, -1);
+        return take_local_work(&local_regs, &local_regs_tail, &local_regs_size);
     }
-    else
+    if (local_dirs_size > 0)
     {
-        send_manager_nonfatal_inc();
+        return take_local_work(&local_dirs, &local_dirs_tail, &local_dirs_size);
     }
+    return NULL;
 }
 
-//functions that workers use
-void errsend(Lethality fatal, const char *error_text)
+// Work to hand to a thief, or NULL.  We keep our last buffer for ourselves,
+// since we'd only have to go and steal something else.
+char *steal_local_work()
 {
-    //send an error message to the outputproc. Die if fatal.
-    char errormsg[MESSAGESIZE] = {0};
+    if (local_dirs_size + local_regs_size < 2)
+    {
+        return NULL;
+    }
+    if (local_dirs_size > 0)
+    {
+        return take_local_work(&local_dirs, &local_dirs_tail, &local_dirs_size);
+    }
+    return take_local_work(&local_regs, &local_regs_tail, &local_regs_size);
+}
 
-#ifdef CONDUIT
-    // possibly send a CONDUIT message, as well
-    snprintf( errormsg, MESSAGESIZE,
-              "#CONDUIT-MSG {\"Type\":\"ERROR\", \"Class\":\"%s\", \"Origin\":\"%s\", \"Errno\":%d, \"Message\":\"%s\"}",
-              (fatal) ? "FATAL" : "NONFATAL", "Unknown", errno, error_text );
-    write_output(errormsg, 1);
-#endif
+static void load_buf_list_head(work_buf_list *head);
 
-    if (fatal)
-        snprintf(errormsg, MESSAGESIZE, "ERROR FATAL: %s\n", error_text);
-    else
-        snprintf(errormsg, MESSAGESIZE, "ERROR NONFATAL: %s\n", error_text);
+static int batch_level = -1; // see update_batch_level().  -1: none yet (use batch_fixed)
 
-    errsend_internal(fatal, errormsg);
+// The queued buffers are already complete messages; just relabel them
+// (with our batch level, too), and hand them over to the send pool.
+void send_buffer_list(int target_rank, int command, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize)
+{
+    load_buf_list_head(*workbuflist);
+    MSG_HDR((*workbuflist)->buf)->opcode = command;
+    MSG_HDR((*workbuflist)->buf)->batch_level = batch_level + 1;
+    send_message_async(target_rank, (*workbuflist)->buf, MPI_TAG_NOT_MORE_WORK);
+    (*workbuflist)->buf = NULL; // now owned by the send pool
+    dequeue_buf_list(workbuflist, workbuftail, workbufsize);
 }
 
-// This allows caller to use inline formatting, without first snprintf() to
-// a local errmsg-buffer.  Like so:
-//
-//    errsend_fmt(NONFATAL, "rank %d hello!", rank);
-//
-void errsend_fmt(Lethality fatal, const char *format, ...)
+// Length of the leading directory-part (including the final '/') that all
+// the paths in <items> have in common.  Zero, if there isn't one.
+static size_t path_batch_prefix(const path_item *const *items, int count)
 {
-    char errormsg[MESSAGESIZE] = {0};
+    int i;
+    size_t j;
+    size_t len;
+    const char *first;
+
+    if (count <= 0)
+    {
+        return 0;
+    }
+    first = items[0]->path;
+    len = strnlen(first, PATHSIZE_PLUS - 1);
+    for (i = 1; (i < count) && len; i++)
+    {
+        const char *path = items[i]->path;
+        for (j = 0; (j < len) && (path[j] == first[j]); j++)
+            ;
+        len = j;
+    }
+    while (len && (first[len - 1] != '/'))
+    {
+        len--;
+    }
+    return len;
+}
+
+// bytes of data that copying/comparing <item> (one chunk) will move
+static size_t path_item_work_bytes(const path_item *item)
+{
+    off_t offset = (off_t)item->chkidx * item->chksz;
+
+    if (!S_ISREG(item->st.st_mode) || (offset >= item->st.st_size))
+    {
+        return 0;
+    }
+    return (((offset + item->chksz) > item->st.st_size)
+                ? (item->st.st_size - offset)
+                : item->chksz);
+}
+
+// number of bytes pack_path_batch() will need for <items>
+int path_batch_size(const path_item *const *items, int count)
+{
+    int i;
+    size_t prefix_len = path_batch_prefix(items, count);
+    size_t strtab_len = prefix_len;
+    const char *last_ts = NULL;
+
+    if (count <= 0)
+    {
+        return 0; // an empty batch is sent as an empty message
+    }
+    for (i = 0; i < count; i++)
+    {
+        strtab_len += strnlen(items[i]->path, PATHSIZE_PLUS - 1) - prefix_len;
+        if (!last_ts || strncmp(last_ts, items[i]->timestamp, DATE_STRING_MAX))
+        {
+            strtab_len += strnlen(items[i]->timestamp, DATE_STRING_MAX - 1);
+            last_ts = items[i]->timestamp;
+        }
+    }
+    return WIRE_ALIGN(sizeof(path_batch_hdr) + count * sizeof(path_item_wire) + strtab_len);
+}
+
+// Pack <items> into <buf> (see path_batch_hdr).  <buf> must be 8-byte
+// aligned (e.g. from malloc), and at least path_batch_size() long.  Returns
+// the number of bytes used.
+int pack_path_batch(const path_item *const *items, int count, char *buf, int bufsize)
+{
+    int i;
+    int size = path_batch_size(items, count);
+    size_t prefix_len = path_batch_prefix(items, count);
+    path_batch_hdr *hdr = (path_batch_hdr *)buf;
+    path_item_wire *rec = (path_item_wire *)(buf + sizeof(path_batch_hdr));
+    char *strtab = (char *)(rec + count);
+    uint32_t strtab_len;
+    const char *last_ts = NULL;
+    uint32_t last_ts_off = 0;
+    uint64_t work_bytes = 0;
+
+    if (size > bufsize)
+    {
+        fprintf(stderr, "pack_path_batch: %d items need %d bytes, only have %d\n",
+                count, size, bufsize);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    if (count <= 0)
+    {
+        return 0;
+    }
+
+    memcpy(strtab, items[0]->path, prefix_len);
+    strtab_len = prefix_len;
+
+    for (i = 0; i < count; i++, rec++)
+    {
+        const path_item *item = items[i];
+        size_t name_len = strnlen(item->path, PATHSIZE_PLUS - 1) - prefix_len;
+
+        rec->size = item->st.st_size;
+        rec->blocks = item->st.st_blocks;
+        rec->ino = item->st.st_ino;
+        rec->chksz = item->chksz;
+        rec->atime_sec = item->st.st_atim.tv_sec;
+        rec->atime_nsec = item->st.st_atim.tv_nsec;
+        rec->mtime_sec = item->st.st_mtim.tv_sec;
+        rec->mtime_nsec = item->st.st_mtim.tv_nsec;
+        rec->ctime_sec = item->st.st_ctim.tv_sec;
+        rec->ctime_nsec = item->st.st_ctim.tv_nsec;
+        rec->mode = item->st.st_mode;
+        rec->uid = item->st.st_uid;
+        rec->gid = item->st.st_gid;
+        rec->chkidx = item->chkidx;
+        rec->chkcnt = item->chkcnt;
+        rec->start = item->start;
+        rec->ftype = item->ftype;
+        rec->dest_ftype = item->dest_ftype;
+        rec->fstype = item->fstype;
+        rec->packable = item->packable;
+        rec->temp_flag = item->temp_flag;
+
+        rec->name_off = strtab_len;
+        rec->name_len = name_len;
+        memcpy(strtab + strtab_len, item->path + prefix_len, name_len);
+        strtab_len += name_len;
+
+        if (!last_ts || strncmp(last_ts, item->timestamp, DATE_STRING_MAX))
+        {
+            last_ts = item->timestamp;
+            last_ts_off = strtab_len;
+            size_t ts_len = strnlen(item->timestamp, DATE_STRING_MAX - 1);
+            memcpy(strtab + strtab_len, item->timestamp, ts_len);
+            strtab_len += ts_len;
+        }
+        rec->ts_off = last_ts_off;
+        rec->ts_len = strnlen(last_ts, DATE_STRING_MAX - 1);
+
+        work_bytes += path_item_work_bytes(item);
+    }
+
+    hdr->count = count;
+    hdr->prefix_len = prefix_len;
+    hdr->strtab_off = (char *)strtab - buf;
+    hdr->strtab_len = strtab_len;
+    hdr->work_bytes = work_bytes;
+    memset(strtab + strtab_len, 0, size - (hdr->strtab_off + strtab_len));
+
+    return size;
+}
+
+// Set up <view> to read the packed batch <buf> in place, and return the
+// number of items.  The header and every record are sanity-checked against
+// the received size here, once, so the accessors don't have to.
+int path_batch_view_init(path_batch_view *view, const char *buf, int bufsize)
+{
+    const path_batch_hdr *hdr = (const path_batch_hdr *)buf;
+    uint32_t i;
+
+    memset(view, 0, sizeof(path_batch_view));
+    if (bufsize == 0)
+    {
+        return 0; // empty batch
+    }
+    if ((bufsize < (int)sizeof(path_batch_hdr)) ||
+        (hdr->strtab_off != sizeof(path_batch_hdr) + hdr->count * sizeof(path_item_wire)) ||
+        ((size_t)hdr->strtab_off + hdr->strtab_len > (size_t)bufsize) ||
+        (hdr->prefix_len > hdr->strtab_len))
+    {
+        errsend_fmt(FATAL, "path_batch_view_init: corrupt batch header (%d bytes)\n", bufsize);
+    }
+    view->hdr = hdr;
+    view->rec = (const path_item_wire *)(buf + sizeof(path_batch_hdr));
+    view->strtab = buf + hdr->strtab_off;
+
+    for (i = 0; i < hdr->count; i++)
+    {
+        const path_item_wire *rec = &view->rec[i];
+        if (((size_t)rec->name_off + rec->name_len > hdr->strtab_len) ||
+            ((size_t)rec->ts_off + rec->ts_len > hdr->strtab_len) ||
+            (hdr->prefix_len + rec->name_len >= PATHSIZE_PLUS) ||
+            (rec->ts_len >= DATE_STRING_MAX))
+        {
+            errsend_fmt(FATAL, "path_batch_view_init: corrupt record %u in batch\n", i);
+        }
+    }
+    return hdr->count;
+}
+
+// Rebuild the full path of item <index> into <path>, which must have room
+// for PATHSIZE_PLUS bytes.  Returns the length of the path.
+size_t path_batch_path(const path_batch_view *view, int index, char *path)
+{
+    const path_item_wire *rec = &view->rec[index];
+    size_t prefix_len = view->hdr->prefix_len;
+
+    memcpy(path, view->strtab, prefix_len);
+    memcpy(path + prefix_len, view->strtab + rec->name_off, rec->name_len);
+    path[prefix_len + rec->name_len] = 0;
+    return prefix_len + rec->name_len;
+}
+
+// Rebuild item <index> of the batch in <view> into <item>.  Fields of
+// <item> that aren't carried on the wire are zeroed, but we only touch the
+// used part of path[] / timestamp[].
+void unpack_path_item(path_item *item, const path_batch_view *view, int index)
+{
+    const path_item_wire *rec = &view->rec[index];
+
+    memset(item, 0, offsetof(path_item, path));
+    item->st.st_size = rec->size;
+    item->st.st_blocks = rec->blocks;
+    item->st.st_ino = rec->ino;
+    item->chksz = rec->chksz;
+    item->st.st_atim.tv_sec = rec->atime_sec;
+    item->st.st_atim.tv_nsec = rec->atime_nsec;
+    item->st.st_mtim.tv_sec = rec->mtime_sec;
+    item->st.st_mtim.tv_nsec = rec->mtime_nsec;
+    item->st.st_ctim.tv_sec = rec->ctime_sec;
+    item->st.st_ctim.tv_nsec = rec->ctime_nsec;
+    item->st.st_mode = rec->mode;
+    item->st.st_uid = rec->uid;
+    item->st.st_gid = rec->gid;
+    item->chkidx = rec->chkidx;
+    item->chkcnt = rec->chkcnt;
+    item->start = rec->start;
+    item->ftype = (FileType)rec->ftype;
+    item->dest_ftype = (FileType)rec->dest_ftype;
+    item->fstype = (FSType)rec->fstype;
+    item->packable = rec->packable;
+    item->temp_flag = rec->temp_flag;
+
+    path_batch_path(view, index, item->path);
+    memcpy(item->timestamp, view->strtab + rec->ts_off, rec->ts_len);
+    item->timestamp[rec->ts_len] = 0;
+}
+
+//manager
+
+// Where workers send their work, stats, and WORKDONE.  With sub-managers,
+// that's the sub-manager for our node.  Errors still go to MANAGER_PROC.
+static int manager_rank = MANAGER_PROC;
+
+void set_manager_rank(int rank)
+{
+    manager_rank = rank;
+}
+
+void send_manager_nonfatal_inc()
+{
+    send_command(MANAGER_PROC, NONFATALINCCMD, MPI_TAG_NOT_MORE_WORK);
+}
+
+void send_manager_chunk_busy()
+{
+    send_command(manager_rank, CHUNKBUSYCMD, MPI_TAG_NOT_MORE_WORK);
+}
+
+void send_manager_copy_stats(int num_copied_files, size_t num_copied_bytes)
+{
+    copy_stats_msg stats;
+
+    stats.num_files = num_copied_files;
+    stats.num_bytes = num_copied_bytes;
+    send_message(manager_rank, COPYSTATSCMD, 0, &stats, sizeof(stats), MPI_TAG_NOT_MORE_WORK);
+}
+
+void send_manager_examined_stats(int num_examined_files, size_t num_examined_bytes, int num_examined_dirs, size_t num_finished_bytes)
+{
+    examined_stats_msg stats;
+
+    stats.num_files = num_examined_files;
+    stats.num_bytes = num_examined_bytes;
+    stats.num_dirs = num_examined_dirs;
+    stats.num_finished_bytes = num_finished_bytes;
+    send_message(manager_rank, EXAMINEDSTATSCMD, 0, &stats, sizeof(stats), MPI_TAG_NOT_MORE_WORK);
+}
+
+void send_manager_regs_buffer(path_item *buffer, int *buffer_count)
+{
+    //sends a chunk of regular files to the manager
+    if (!local_work)
+    {
+        send_path_buffer(manager_rank, PROCESSCMD, buffer, buffer_count);
+    }
+    else if (local_work_type == COPYWORK)
+    {
+        queue_local_work(COPYCMD, buffer, buffer_count);
+    }
+    else if (local_work_type == COMPAREWORK)
+    {
+        queue_local_work(COMPARECMD, buffer, buffer_count);
+    }
+    else
+    {
+        *buffer_count = 0; // listing is already done
+    }
+}
+
+void send_manager_dirs_buffer(path_item *buffer, int *buffer_count)
+{
+    //sends a chunk of regular files to the manager
+    if (!local_work)
+    {
+        send_path_buffer(manager_rank, DIRCMD, buffer, buffer_count);
+    }
+    else if (local_recurse)
+    {
+        queue_local_work(DIRCMD, buffer, buffer_count);
+    }
+    else
+    {
+        *buffer_count = 0;
+    }
+}
+
+void send_manager_work_done(int ignored)
+{
+    //the worker is finished processing, notify the manager
+    flush_output();
+    if (!local_work)
+    {
+        send_command(manager_rank, WORKDONECMD, MPI_TAG_NOT_MORE_WORK);
+        return;
+    }
+
+    // With work-stealing, the manager counts buffers, to know when we're
+    // all done.  Once we return, the ones we just created could be stolen,
+    // finished, and reported by someone else.  The manager must have
+    // counted them before that, so this send is synchronous.
+    workdone_msg done;
+    done.created = local_created;
+    local_created = 0;
+    if (!done.created)
+    {
+        send_message(manager_rank, WORKDONECMD, 0, &done, sizeof(done), MPI_TAG_NOT_MORE_WORK);
+        return;
+    }
+    struct
+    {
+        msg_hdr hdr;
+        workdone_msg done;
+    } msg;
+    msg.hdr.opcode = WORKDONECMD;
+    msg.hdr.count = 0;
+    msg.hdr.payload_len = sizeof(done);
+    msg.hdr.batch_level = 0;
+    msg.done = done;
+    if (MPI_Ssend(&msg, sizeof(msg), MPI_BYTE, manager_rank, MPI_TAG_NOT_MORE_WORK, MPI_COMM_WORLD) != MPI_SUCCESS)
+    {
+        fprintf(stderr, "Failed to send WORKDONECMD to rank %d\n", manager_rank);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+}
+
+//worker
+void update_chunk(path_item *buffer, int *buffer_count)
+{
+    send_path_buffer(ACCUM_PROC, UPDCHUNKCMD, buffer, buffer_count);
+}
+
+// Output lines waiting to go to OUTPUT_PROC.  <output_msg> is a whole
+// BUFFEROUTCMD message, filled in place, and handed off to the send-pool when
+// it is flushed.
+static char *output_msg = NULL;
+static int output_len = 0;      // bytes of payload used
+static int output_count = 0;    // output_recs in the payload
+static double output_oldest;    // MPI_Wtime() of the first buffered line
+static int output_rank = -1;
+
+// With '-L', a worker's output goes straight to its own shard file instead.
+// Each line is prefixed with the wall-clock time, so pflogmerge can put the
+// shards back together in order.
+static FILE *output_shard = NULL;
+static char *output_shard_buf = NULL;
+
+void open_output_shard(const char *log_dir, const char *jid, int rank)
+{
+    char shard_path[PATHSIZE_PLUS];
+
+    output_rank = rank;
+    if (mkdir(log_dir, 0755) && (errno != EEXIST))
+    {
+        errsend_fmt(FATAL, "Failed to create log directory '%s': %s\n", log_dir, strerror(errno));
+    }
+    snprintf(shard_path, PATHSIZE_PLUS, "%s/pftool.%s.%05d.log", log_dir, jid, rank);
+    output_shard = fopen(shard_path, "w");
+    if (!output_shard)
+    {
+        errsend_fmt(FATAL, "Failed to open log shard '%s': %s\n", shard_path, strerror(errno));
+    }
+    output_shard_buf = (char *)malloc(OUTPUT_BUFFER_SIZE);
+    if (output_shard_buf)
+    {
+        setvbuf(output_shard, output_shard_buf, _IOFBF, OUTPUT_BUFFER_SIZE);
+    }
+}
+
+void close_output_shard()
+{
+    if (output_shard)
+    {
+        fclose(output_shard);
+        output_shard = NULL;
+        free(output_shard_buf);
+        output_shard_buf = NULL;
+    }
+}
+
+// "<sec>.<usec> RANK <rank>: <text>", always ending with a newline
+static void write_output_shard(const char *message)
+{
+    struct timeval tv;
+    size_t len = strnlen(message, MESSAGESIZE - 1);
+
+    gettimeofday(&tv, NULL);
+    fprintf(output_shard, "%ld.%06ld RANK %3d: ", (long)tv.tv_sec, (long)tv.tv_usec, output_rank);
+    fwrite(message, 1, len, output_shard);
+    if (!len || (message[len - 1] != '\n'))
+    {
+        fputc('\n', output_shard);
+    }
+}
+
+// send any buffered output lines to OUTPUT_PROC
+void flush_output()
+{
+    if (!output_count)
+    {
+        return;
+    }
+    MSG_HDR(output_msg)->count = output_count;
+    MSG_HDR(output_msg)->payload_len = output_len;
+    send_message_async(OUTPUT_PROC, output_msg, MPI_TAG_NOT_MORE_WORK);
+    output_msg = NULL;
+    output_len = 0;
+    output_count = 0;
+}
+
+// Queue a single line for the outputproc.  Lines are batched, and only sent
+// when the buffer fills, when the oldest line gets stale, or when this rank
+// goes idle, reports WORKDONE, or exits.  (See flush_output())
+void write_output(const char *message, int log)
+{
+    output_rec rec;
+
+    if (on_pool_thread)
+    {
+        funnel_push(FUNNEL_OUTPUT, log, 0, strndup(message, MESSAGESIZE - 1));
+        return;
+    }
+    if (output_shard)
+    {
+        write_output_shard(message);
+        if (log == 0)
+        {
+            return;
+        }
+        // errors and syslog lines also go to OUTPUT_PROC, as usual
+    }
+
+    rec.len = strnlen(message, MESSAGESIZE - 1) + 1;
+    rec.log = log;
+
+    if (output_msg && (output_len + sizeof(rec) + rec.len > OUTPUT_BUFFER_SIZE))
+    {
+        flush_output();
+    }
+    if (!output_msg)
+    {
+        output_msg = (char *)malloc(sizeof(msg_hdr) + OUTPUT_BUFFER_SIZE);
+        if (!output_msg)
+        {
+            fprintf(stderr, "Failed to allocate %lu bytes for output_msg\n", sizeof(msg_hdr) + OUTPUT_BUFFER_SIZE);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        MSG_HDR(output_msg)->opcode = BUFFEROUTCMD;
+        MSG_HDR(output_msg)->batch_level = 0;
+    }
+    if (!output_count)
+    {
+        output_oldest = MPI_Wtime();
+    }
+
+    memcpy(MSG_PAYLOAD(output_msg) + output_len, &rec, sizeof(rec));
+    output_len += sizeof(rec);
+    memcpy(MSG_PAYLOAD(output_msg) + output_len, message, rec.len - 1);
+    output_len += rec.len;
+    MSG_PAYLOAD(output_msg)[output_len - 1] = 0;
+    output_count++;
+
+    // OUTPUT_PROC sends its own lines to itself, and must not be holding any
+    // when it gets EXIT.
+    if (output_rank < 0)
+    {
+        MPI_Comm_rank(MPI_COMM_WORLD, &output_rank);
+    }
+    if ((output_rank == OUTPUT_PROC) || (MPI_Wtime() - output_oldest >= OUTPUT_FLUSH_SECS))
+    {
+        flush_output();
+    }
+}
+
+// flush buffered output, if the oldest line has waited too long
+static void flush_stale_output()
+{
+    if (output_count && (MPI_Wtime() - output_oldest >= OUTPUT_FLUSH_SECS))
+    {
+        flush_output();
+    }
+}
+
+// This allows caller to use inline formatting, without first snprintf() to
+// a local errmsg-buffer.  Like so:
+//
+//    output_fmt(1, "rank %d hello!", rank);
+//
+void output_fmt(int log, const char *format, ...)
+{
+    char msg[MESSAGESIZE] = {0};
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(msg, MESSAGESIZE, format, args);
+    va_end(args);
+
+    // msg[MESSAGESIZE -1] = 0;  /* no need for this */
+    write_output(msg, log);
+}
+
+void send_worker_queue_count(int target_rank, int queue_count)
+{
+    if (MPI_Send(&queue_count, 1, MPI_INT, target_rank, MPI_TAG_NOT_MORE_WORK, MPI_COMM_WORLD) != MPI_SUCCESS)
+    {
+        fprintf(stderr, "Failed to queue_count %d to rank %d\n", queue_count, target_rank);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+}
+
+void send_worker_readdir(int target_rank, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize)
+{
+    //send a worker a buffer list of paths to stat
+    send_buffer_list(target_rank, DIRCMD, workbuflist, workbuftail, workbufsize);
+}
+
+void send_worker_copy_path(int target_rank, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize)
+{
+    //send a worker a list buffers with paths to copy
+    send_buffer_list(target_rank, COPYCMD, workbuflist, workbuftail, workbufsize);
+}
+
+void send_worker_compare_path(int target_rank, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize)
+{
+    //send a worker a list buffers with paths to compare
+    send_buffer_list(target_rank, COMPARECMD, workbuflist, workbuftail, workbufsize);
+}
+
+void send_worker_exit(int target_rank)
+{
+    //order a rank to exit, after anything we've said to OUTPUT_PROC
+    flush_output();
+    send_command(target_rank, EXITCMD, MPI_TAG_NOT_MORE_WORK);
+}
+
+static void errsend_internal(Lethality fatal, const char *errormsg)
+{
+    // A pool thread can't abort the job itself.  The main thread will,
+    // when it gets this.  Until then, we mustn't go on.
+    if (on_pool_thread)
+    {
+        funnel_push(FUNNEL_ERROR, fatal, 0, strndup(errormsg, MESSAGESIZE - 1));
+        while (fatal)
+        {
+            pause();
+        }
+        return;
+    }
+
+    write_output(errormsg, 1);
+
+    if (fatal)
+    {
+        // give the message (and anything before it) a moment to get out.
+        // Can't just drain_sends(), we might be the OUTPUT_PROC.
+        flush_output();
+        if (output_shard)
+        {
+            fflush(output_shard);
+        }
+        for (int i = 0; (i < 1000) && progress_sends(); i++)
+        {
+            usleep(1000);
+        }
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    else
+    {
+        send_manager_nonfatal_inc();
+    }
+}
+
+//functions that workers use
+void errsend(Lethality fatal, const char *error_text)
+{
+    //send an error message to the outputproc. Die if fatal.
+    char errormsg[MESSAGESIZE] = {0};
+
+#ifdef CONDUIT
+    // possibly send a CONDUIT message, as well
+    snprintf( errormsg, MESSAGESIZE,
+              "#CONDUIT-MSG {\"Type\":\"ERROR\", \"Class\":\"%s\", \"Origin\":\"%s\", \"Errno\":%d, \"Message\":\"%s\"}",
+              (fatal) ? "FATAL" : "NONFATAL", "Unknown", errno, error_text );
+    write_output(errormsg, 1);
+#endif
+
+    if (fatal)
+        snprintf(errormsg, MESSAGESIZE, "ERROR FATAL: %s\n", error_text);
+    else
+        snprintf(errormsg, MESSAGESIZE, "ERROR NONFATAL: %s\n", error_text);
+
+    errsend_internal(fatal, errormsg);
+}
+
+// This allows caller to use inline formatting, without first snprintf() to
+// a local errmsg-buffer.  Like so:
+//
+//    errsend_fmt(NONFATAL, "rank %d hello!", rank);
+//
+void errsend_fmt(Lethality fatal, const char *format, ...)
+{
+    char errormsg[MESSAGESIZE] = {0};
     va_list args;
 
 #ifdef CONDUIT
@@ -1601,55 +2594,645 @@ void get_stat_fs_info(const char *path, SrcDstFSType *fs)
         {
             *fs = PANASASFS;
         }
-        else
+        else
+        {
+            *fs = ANYFS; // NOTE: less than PARALLEL_DESTFS
+        }
+    }
+    else
+    {
+        //symlink assumed to be GPFS
+        *fs = GPFSFS;
+    }
+
+#else
+    *fs = ANYFS; // NOTE: less than PARALLEL_DESTFS
+#endif
+}
+
+// worker_pool keeps one bit per rank in its free/capable bitmaps
+#define POOL_WORD(rank) ((rank) >> 6)
+#define POOL_BIT(rank) (1ULL << ((rank)&63))
+
+// Fill in <nodes>[r] with the node that rank <r> is on, for every rank.
+// A node is named by the lowest world rank on it.  Collective over
+// MPI_COMM_WORLD.
+void assign_nodes(int *nodes, int rank, int nproc)
+{
+    MPI_Comm node_comm;
+    int first;
+
+    if (MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm) != MPI_SUCCESS)
+    {
+        fprintf(stderr, "Failed to split MPI_COMM_WORLD by node\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    MPI_Allreduce(&rank, &first, 1, MPI_INT, MPI_MIN, node_comm);
+    MPI_Allgather(&first, 1, MPI_INT, nodes, 1, MPI_INT, MPI_COMM_WORLD);
+    MPI_Comm_free(&node_comm);
+}
+
+// With '-H', pick one sub-manager per node: the lowest worker rank on each
+// node that has at least SUBMGR_MIN_WORKERS other workers.  Fills in
+// <managers>[r] with the rank that feeds rank <r> (MANAGER_PROC, or r's
+// sub-manager), for every rank, from <nodes> (see assign_nodes()).
+void assign_sub_managers(int *managers, const int *nodes, int nproc)
+{
+    int *sub = (int *)malloc(nproc * sizeof(int));          // indexed by node
+    int *node_workers = (int *)calloc(nproc, sizeof(int)); // ... besides <sub>
+    int i;
+
+    if (!sub || !node_workers)
+    {
+        fprintf(stderr, "Failed to allocate %lu bytes for sub-managers\n", nproc * sizeof(int));
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    for (i = 0; i < nproc; i++)
+    {
+        sub[i] = -1;
+    }
+    for (i = START_PROC; i < nproc; i++)
+    {
+        if (sub[nodes[i]] < 0)
+        {
+            sub[nodes[i]] = i;
+        }
+        else
+        {
+            node_workers[nodes[i]]++;
+        }
+    }
+    for (i = 0; i < nproc; i++)
+    {
+        managers[i] = MANAGER_PROC;
+        if ((i >= START_PROC) && (i != sub[nodes[i]]) && (node_workers[nodes[i]] >= SUBMGR_MIN_WORKERS))
+        {
+            managers[i] = sub[nodes[i]];
+        }
+    }
+    free(sub);
+    free(node_workers);
+}
+
+// number of workers fed by <rank> (zero if it isn't a sub-manager)
+int sub_manager_workers(const int *managers, int nproc, int rank)
+{
+    int count = 0;
+    int i;
+
+    if (!managers || (rank == MANAGER_PROC))
+    {
+        return 0;
+    }
+    for (i = START_PROC; i < nproc; i++)
+    {
+        if (managers[i] == rank)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Every worker rank fed by <owner> starts out free, and capable of every
+// kind of work.  A sub-manager gets one slot per worker it feeds.  With no
+// <managers>, that's every worker, with one slot each.
+void init_worker_pool(worker_pool *pool, int nproc, const int *managers, const int *nodes, int owner)
+{
+    int set;
+    int i;
+
+    memset(pool, 0, sizeof(worker_pool));
+    pool->nproc = nproc;
+    pool->nwords = POOL_WORD(nproc - 1) + 1;
+    pool->status = (struct worker_proc_status *)calloc(nproc, sizeof(struct worker_proc_status));
+    pool->outstanding = (size_t *)calloc(nproc, sizeof(size_t));
+    pool->slots = (int *)calloc(nproc, sizeof(int));
+    pool->nodes = nodes;
+    pool->node_busy = (int *)calloc(nproc, sizeof(int));
+    pool->node_slots = (int *)calloc(nproc, sizeof(int));
+    if (!pool->status || !pool->outstanding || !pool->slots || !pool->node_busy || !pool->node_slots)
+    {
+        fprintf(stderr, "manager; couldn't allocate %lu bytes for proc_status\n", nproc * sizeof(struct worker_proc_status));
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    for (i = START_PROC; i < nproc; i++)
+    {
+        if (!managers || (managers[i] == owner))
+        {
+            pool->slots[i] = sub_manager_workers(managers, nproc, i);
+            if (!pool->slots[i])
+            {
+                pool->slots[i] = 1;
+            }
+            pool->nslots += pool->slots[i];
+            pool->node_slots[nodes[i]] += pool->slots[i];
+        }
+    }
+    for (set = 0; set < NUM_WORKER_SETS; set++)
+    {
+        pool->capable[set] = (uint64_t *)calloc(pool->nwords, sizeof(uint64_t));
+        pool->free[set] = (uint64_t *)calloc(pool->nwords, sizeof(uint64_t));
+        if (!pool->capable[set] || !pool->free[set])
+        {
+            fprintf(stderr, "manager; couldn't allocate %lu bytes for worker bitmaps\n", pool->nwords * sizeof(uint64_t));
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        for (i = START_PROC; i < nproc; i++)
+        {
+            if (pool->slots[i])
+            {
+                pool->capable[set][POOL_WORD(i)] |= POOL_BIT(i);
+                pool->free[set][POOL_WORD(i)] |= POOL_BIT(i);
+            }
+        }
+        pool->hint[set] = POOL_WORD(START_PROC);
+    }
+    pool->free_count = pool->nslots;
+}
+
+void destroy_worker_pool(worker_pool *pool)
+{
+    int set;
+
+    for (set = 0; set < NUM_WORKER_SETS; set++)
+    {
+        free(pool->capable[set]);
+        free(pool->free[set]);
+    }
+    free(pool->status);
+    free(pool->outstanding);
+    free(pool->slots);
+    free(pool->node_busy);
+    free(pool->node_slots);
+    memset(pool, 0, sizeof(worker_pool));
+}
+
+// return the lowest free rank that can do work of type <set>, or -1
+int get_free_rank(worker_pool *pool, int set)
+{
+    uint64_t *bits = pool->free[set];
+    int w;
+
+    for (w = pool->hint[set]; w < pool->nwords; w++)
+    {
+        if (bits[w])
+        {
+            pool->hint[set] = w;
+            return (w << 6) + __builtin_ctzll(bits[w]);
+        }
+    }
+    pool->hint[set] = pool->nwords;
+    return -1;
+}
+
+static const char *placements[NUM_PLACEMENTS] = {"any", "spread", "local"};
+
+const char *placement_name(int placement)
+{
+    return placements[placement];
+}
+
+// returns a ChunkPlacement, or -1 if <arg> isn't one we know
+int parse_placement(const char *arg)
+{
+    int i;
+
+    for (i = 0; i < NUM_PLACEMENTS; i++)
+    {
+        if (!strcmp(arg, placements[i]))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// With PLACE_LOCAL, the home node of each chunked file that still has
+// chunks waiting to be handed out (keyed by source path).
+typedef struct place_home
+{
+    int node;
+    int remain;     // chunks not yet handed out
+    double waiting; // MPI_Wtime() when the home node was first found full, or 0
+} place_home;
+
+static std::map<std::string, place_home> place_homes;
+
+// The buffer in <view> is going to a rank on <node>.  Count off the chunks
+// in it, and forget the home of any file that has none left.  The first
+// item was the one placed, so its file moves to <node>, if it wasn't there.
+static void place_chunks(const path_batch_view *view, int node)
+{
+    char path[PATHSIZE_PLUS];
+    int i;
+
+    for (i = 0; i < (int)view->hdr->count; i++)
+    {
+        const path_item_wire *rec = &view->rec[i];
+        std::map<std::string, place_home>::iterator it;
+
+        if (rec->chksz >= rec->size)
+        {
+            continue; // not a chunk
+        }
+        path_batch_path(view, i, path);
+        it = place_homes.find(path);
+        if (it == place_homes.end())
+        {
+            place_home home = {node, rec->chkcnt, 0};
+            it = place_homes.insert(std::make_pair(std::string(path), home)).first;
+        }
+        else if (i == 0)
+        {
+            it->second.node = node;
+            it->second.waiting = 0;
+        }
+        if (--it->second.remain <= 0)
+        {
+            place_homes.erase(it);
+        }
+    }
+}
+
+// Choose a free rank that can do work of type <set>, for the buffer at
+// <head>, according to <placement> (see ChunkPlacement).  Ranks on a node
+// share its NIC, so for a parallel destination it matters more which node
+// gets a chunk than which rank.  Returns -1 if there is no free rank, or
+// (with PLACE_LOCAL) none on the home node of the chunk at <head>.  In that
+// case the chunk should wait, but not for more than PLACE_WAIT_SECS: after
+// that it goes to the best free rank, and its file gets a new home.
+int get_placed_rank(worker_pool *pool, int set, int placement, work_buf_list *head)
+{
+    path_batch_view view;
+    int chunk = 0;
+    int home = -1;
+    int best;
+    int rank;
+    int w;
+    place_home *entry = NULL;
+
+    best = get_free_rank(pool, set); // also moves the hint up
+    if ((best < 0) || (placement == PLACE_ANY))
+    {
+        return best;
+    }
+
+    // With PLACE_LOCAL, only chunks of a file have a home node: the node
+    // with the most idle slots when its first chunk is placed.  Other work
+    // is placed as with PLACE_SPREAD.
+    if (placement == PLACE_LOCAL)
+    {
+        char path[PATHSIZE_PLUS];
+        std::map<std::string, place_home>::iterator it;
+
+        load_buf_list_head(head);
+        if (path_batch_view_init(&view, MSG_PAYLOAD(head->buf), MSG_HDR(head->buf)->payload_len) <= 0)
+        {
+            return best;
+        }
+        if (view.rec[0].chksz < view.rec[0].size)
+        {
+            chunk = 1;
+            path_batch_path(&view, 0, path);
+            it = place_homes.find(path);
+            if (it != place_homes.end())
+            {
+                entry = &it->second;
+                home = entry->node;
+            }
+        }
+    }
+
+    for (w = pool->hint[set]; w < pool->nwords; w++)
+    {
+        uint64_t bits = pool->free[set][w];
+        while (bits)
+        {
+            rank = (w << 6) + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (pool->nodes[rank] == home)
+            {
+                place_chunks(&view, home);
+                return rank;
+            }
+            if (chunk)
+            {
+                if ((pool->node_slots[pool->nodes[rank]] - pool->node_busy[pool->nodes[rank]]) >
+                    (pool->node_slots[pool->nodes[best]] - pool->node_busy[pool->nodes[best]]))
+                {
+                    best = rank;
+                }
+            }
+            else if (pool->node_busy[pool->nodes[rank]] < pool->node_busy[pool->nodes[best]])
+            {
+                best = rank;
+            }
+        }
+    }
+    if (home >= 0)
+    {
+        double now = MPI_Wtime();
+
+        if (!entry->waiting)
+        {
+            entry->waiting = now;
+        }
+        if ((now - entry->waiting) < PLACE_WAIT_SECS)
         {
-            *fs = ANYFS; // NOTE: less than PARALLEL_DESTFS
+            return -1; // wait for the home node
         }
     }
-    else
+    if (placement == PLACE_LOCAL)
     {
-        //symlink assumed to be GPFS
-        *fs = GPFSFS;
+        place_chunks(&view, pool->nodes[best]);
     }
+    return best;
+}
 
-#else
-    *fs = ANYFS; // NOTE: less than PARALLEL_DESTFS
-#endif
+// <work_bytes> is the amount of data in the work handed to <rank>
+void set_rank_busy(worker_pool *pool, int rank, int readdir, size_t work_bytes)
+{
+    int set;
+
+    pool->outstanding[rank] += work_bytes;
+    pool->busy_bytes += work_bytes;
+
+    pool->status[rank].inuse += 1;
+    if (rank < START_PROC)
+    {
+        pool->busy_helpers += 1;
+    }
+    else if (pool->status[rank].inuse <= pool->slots[rank])
+    {
+        pool->free_count -= 1;
+        if (pool->status[rank].inuse == pool->slots[rank])
+        {
+            for (set = 0; set < NUM_WORKER_SETS; set++)
+            {
+                pool->free[set][POOL_WORD(rank)] &= ~POOL_BIT(rank);
+            }
+        }
+    }
+    if (rank >= START_PROC)
+    {
+        pool->node_busy[pool->nodes[rank]] += 1;
+    }
+    if (readdir && !pool->status[rank].readdir)
+    {
+        pool->status[rank].readdir = 1;
+        pool->readdir_count += 1;
+    }
 }
 
-// NOTE: master spending ~50% time in this function.
-// all callers provide <start_range>==START_PROC
-int get_free_rank(struct worker_proc_status *proc_status, int start_range, int end_range)
+// One buffer handed to <rank> is done.  A helper's count may go negative
+// for a while, if its WORKDONE overtakes the CHUNKBUSY that made it busy.
+void set_rank_free(worker_pool *pool, int rank)
 {
-    //given an inclusive range, return the first encountered free rank
-    int i;
-    for (i = start_range; i <= end_range; i++)
+    int set;
+    size_t done_bytes;
+
+    if (rank < START_PROC)
+    {
+        pool->status[rank].inuse -= 1;
+        pool->busy_helpers -= 1;
+        return;
+    }
+    if (pool->status[rank].inuse <= 0)
+    {
+        return;
+    }
+
+    // we don't know which of several buffers finished; assume an even share
+    done_bytes = pool->outstanding[rank] / pool->status[rank].inuse;
+    pool->outstanding[rank] -= done_bytes;
+    pool->busy_bytes -= done_bytes;
+
+    if (pool->status[rank].inuse <= pool->slots[rank])
     {
-        if (proc_status[i].inuse == 0)
+        if (pool->status[rank].inuse == pool->slots[rank])
         {
-            return i;
+            for (set = 0; set < NUM_WORKER_SETS; set++)
+            {
+                if (pool->capable[set][POOL_WORD(rank)] & POOL_BIT(rank))
+                {
+                    pool->free[set][POOL_WORD(rank)] |= POOL_BIT(rank);
+                    if (POOL_WORD(rank) < pool->hint[set])
+                    {
+                        pool->hint[set] = POOL_WORD(rank);
+                    }
+                }
+            }
         }
+        pool->free_count += 1;
+    }
+    pool->status[rank].inuse -= 1;
+    pool->node_busy[pool->nodes[rank]] -= 1;
+    if (!pool->status[rank].inuse && pool->status[rank].readdir)
+    {
+        pool->status[rank].readdir = 0;
+        pool->readdir_count -= 1;
     }
-    return -1;
 }
 
 //are all the ranks free?
 // return 1 for yes, 0 for no.
-int processing_complete(struct worker_proc_status *proc_status, int free_worker_count, int nproc)
+int processing_complete(worker_pool *pool)
+{
+    return ((pool->free_count == pool->nslots) && (pool->busy_helpers == 0) && (pool->pending_bufs == 0));
+}
+
+// Dispatch policies.  Each one looks at the manager's queues and worker
+// pool, and fills in a dispatch_plan for the next pass through its loop.
+typedef void (*dispatch_plan_fn)(dispatch_policy *policy, const worker_pool *pool,
+                                 int process_queued, int dir_queued, dispatch_plan *plan);
+
+// a few copies, then one readdir, per pass (the original behavior)
+static void plan_default(dispatch_policy *policy, const worker_pool *pool,
+                         int process_queued, int dir_queued, dispatch_plan *plan)
+{
+    plan->readdir_first = 0;
+    plan->process_max = 3;
+    plan->readdir_max = 1;
+    plan->readdir_ranks = -1;
+}
+
+// Every free rank reads directories, while there are any.  Good for deep,
+// metadata-heavy trees, where the copy work is small.
+static void plan_discovery(dispatch_policy *policy, const worker_pool *pool,
+                           int process_queued, int dir_queued, dispatch_plan *plan)
+{
+    plan->readdir_first = 1;
+    plan->process_max = -1;
+    plan->readdir_max = -1;
+    plan->readdir_ranks = -1;
+}
+
+// Every free rank gets copy/compare work, while there is any, and
+// directories trickle out one per pass.  Good for a few huge files.
+static void plan_throughput(dispatch_policy *policy, const worker_pool *pool,
+                            int process_queued, int dir_queued, dispatch_plan *plan)
 {
-    if (free_worker_count == (nproc - START_PROC))
+    plan->readdir_first = 0;
+    plan->process_max = -1;
+    plan->readdir_max = 1;
+    plan->readdir_ranks = -1;
+}
+
+// Copy/compare work first, but the number of ranks allowed to read
+// directories moves up by one on each pass while the copy queue is below
+// the low watermark, and down by one while it's above the high one.
+static void plan_ratio(dispatch_policy *policy, const worker_pool *pool,
+                       int process_queued, int dir_queued, dispatch_plan *plan)
+{
+    if ((process_queued < policy->low) && (policy->readdir_ranks < pool->nslots))
     {
-        int i;
-        for (i = 0; i < START_PROC; i++)
+        policy->readdir_ranks += 1;
+    }
+    else if ((process_queued > policy->high) && (policy->readdir_ranks > 1))
+    {
+        policy->readdir_ranks -= 1;
+    }
+    plan->readdir_first = 0;
+    plan->process_max = -1;
+    plan->readdir_max = -1;
+    plan->readdir_ranks = policy->readdir_ranks;
+}
+
+static const struct
+{
+    const char *name;
+    dispatch_plan_fn plan;
+} dispatch_policies[NUM_DISPATCH_POLICIES] = {
+    {"default", plan_default},
+    {"discovery", plan_discovery},
+    {"throughput", plan_throughput},
+    {"ratio", plan_ratio}};
+
+const char *dispatch_policy_name(int policy)
+{
+    return dispatch_policies[policy].name;
+}
+
+// Parse "<name>", or "ratio:<low>:<high>".  Returns 0 for success, -1 if
+// <arg> isn't a policy we know.
+int parse_dispatch_policy(const char *arg, int *policy, int *low, int *high)
+{
+    const char *colon = strchr(arg, ':');
+    size_t len = (colon ? (size_t)(colon - arg) : strlen(arg));
+    int i;
+
+    for (i = 0; i < NUM_DISPATCH_POLICIES; i++)
+    {
+        if ((strlen(dispatch_policies[i].name) == len) && !strncmp(arg, dispatch_policies[i].name, len))
         {
-            if (proc_status[i].inuse)
-                return 0;
+            break;
+        }
+    }
+    if (i == NUM_DISPATCH_POLICIES)
+    {
+        return -1;
+    }
+    *policy = i;
+    if (colon)
+    {
+        if ((i != DISPATCH_RATIO) || (sscanf(colon, ":%d:%d", low, high) != 2) || (*low < 0) || (*high < *low))
+        {
+            return -1;
         }
-        return 1;
     }
     return 0;
 }
 
+void init_dispatch_policy(dispatch_policy *policy, const worker_pool *pool, int type, int low, int high)
+{
+    policy->policy = type;
+    policy->low = low;
+    policy->high = high;
+    policy->readdir_ranks = pool->nslots; // nothing queued yet
+}
+
+// Fill in <plan>.  '-M' (<max_readdir_ranks>) applies on top of any policy.
+void plan_dispatch(dispatch_policy *policy, const worker_pool *pool, int process_queued, int dir_queued, int max_readdir_ranks, dispatch_plan *plan)
+{
+    dispatch_policies[policy->policy].plan(policy, pool, process_queued, dir_queued, plan);
+    if ((max_readdir_ranks != -1) &&
+        ((plan->readdir_ranks == -1) || (plan->readdir_ranks > max_readdir_ranks)))
+    {
+        plan->readdir_ranks = max_readdir_ranks;
+    }
+}
+
+// Batch sizes, at each batch level, smallest first.
+static const struct
+{
+    size_t limits[4]; // indexed by BatchKind
+} batch_levels[BATCH_LEVELS] = {
+    {{1, 64, 16, 67108864}},
+    {{2, 256, 64, 134217728}},
+    {{5, 1024, 256, 268435456}},
+    {{16, 2048, 1024, 536870912}},
+    {{32, STATBUFFER, 2048, SHIPOFF}},
+    {{DIRBUFFER, STATBUFFER, COPYBUFFER, SHIPOFF}}};
+
+// the fixed sizes we used before, for work that comes without a batch
+// level (e.g. with work-stealing, where there's no manager to pick one)
+static const size_t batch_fixed[4] = {5, STATBUFFER, COPYBUFFER, SHIPOFF};
+
+// Manager: move the batch level (see BATCH_ADJUST_SECS), given the number
+// of buffers it has <queued>.  It goes out with everything that
+// send_buffer_list() sends.  We start at the bottom, so the first few
+// directories get spread around.
+void update_batch_level(const worker_pool *pool, int queued)
+{
+    static double last_adjust = 0;
+    double now = MPI_Wtime();
+
+    if (batch_level < 0)
+    {
+        batch_level = 0;
+        last_adjust = now;
+        return;
+    }
+    if (now - last_adjust < BATCH_ADJUST_SECS)
+    {
+        return;
+    }
+    last_adjust = now;
+    if ((pool->free_count > queued) && (batch_level > 0))
+    {
+        batch_level -= 1;
+        PRINT_MPI_DEBUG("update_batch_level() %d free, %d queued: level %d\n", pool->free_count, queued, batch_level);
+    }
+    else if ((queued > pool->nslots) && (batch_level < BATCH_LEVELS - 1))
+    {
+        batch_level += 1;
+        PRINT_MPI_DEBUG("update_batch_level() %d free, %d queued: level %d\n", pool->free_count, queued, batch_level);
+    }
+}
+
+// Worker or sub-manager: adopt the batch level that came with <msg>, if any.
+void take_batch_level(const char *msg)
+{
+    int level = MSG_HDR(msg)->batch_level - 1;
+    if ((level >= 0) && (level < BATCH_LEVELS))
+    {
+        batch_level = level;
+    }
+}
+
+size_t batch_limit(int kind)
+{
+    return ((batch_level < 0) ? batch_fixed[kind] : batch_levels[batch_level].limits[kind]);
+}
+
+// Should a batch of <count> items of <kind>, collected since <since>
+// (MPI_Wtime()), be sent off now?
+int batch_ready(int kind, int count, double since)
+{
+    return (count && (((size_t)count >= batch_limit(kind)) || (MPI_Wtime() - since >= BATCH_FLUSH_SECS)));
+}
+
 //Queue Function Definitions
 
 // push path onto the tail of the queue
@@ -1745,52 +3328,370 @@ void dequeue_node(path_list **head, path_list **tail, int *count)
     *count -= 1;
 }
 
-void enqueue_buf_list(work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize, char *buffer, int buffer_size)
+// Queued work-buffers beyond <spill_mem_max> bytes go to an unlinked file
+// in <spill_dir>, mapped at <spill_map>.  They're appended at <spill_end>,
+// and read back in whatever order their queues reach them, so the space
+// each one used is handed back (punched out of the file) when it's read.
+// Once the file is empty, we start over at the beginning.
+static size_t spill_mem_max = 0; // 0: never spill
+static size_t spill_mem = 0;     // bytes of queued buffers now in memory
+static char spill_dir[PATHSIZE_PLUS];
+static int spill_fd = -1;
+static char *spill_map = NULL;
+static size_t spill_mapped = 0;
+static size_t spill_end = 0;
+static long spill_now = 0;   // buffers now in the file
+static long spill_total = 0; // buffers ever spilled
+
+void init_work_spill(const char *dir, size_t mem_max)
+{
+    strncpy(spill_dir, dir, PATHSIZE_PLUS - 1);
+    spill_mem_max = mem_max;
+}
+
+void close_work_spill()
+{
+    if (spill_map)
+    {
+        munmap(spill_map, spill_mapped);
+    }
+    if (spill_fd >= 0)
+    {
+        close(spill_fd);
+    }
+    spill_map = NULL;
+    spill_mapped = 0;
+    spill_fd = -1;
+    spill_end = 0;
+}
+
+long work_spill_count()
+{
+    return spill_total;
+}
+
+// make sure the spill file has room for <need> bytes, from the start
+static void spill_reserve(size_t need)
+{
+    char path[PATHSIZE_PLUS];
+    size_t size;
+    void *map;
+
+    if (need <= spill_mapped)
+    {
+        return;
+    }
+    if (spill_fd < 0)
+    {
+        int len = snprintf(path, PATHSIZE_PLUS, "%s/" WORK_SPILL_TEMPLATE, spill_dir);
+        if ((len < 0) || (len >= PATHSIZE_PLUS))
+        {
+            errsend_fmt(FATAL, "Scratch directory name too long for a work spill-file '%s'\n", spill_dir);
+        }
+        spill_fd = mkstemp(path);
+        if (spill_fd < 0)
+        {
+            errsend_fmt(FATAL, "Failed to create work spill-file in '%s': %s\n", spill_dir, strerror(errno));
+        }
+        unlink(path); // gone when we close it
+    }
+    size = ((need + WORK_SPILL_GROW - 1) / WORK_SPILL_GROW) * WORK_SPILL_GROW;
+    if (ftruncate(spill_fd, size))
+    {
+        errsend_fmt(FATAL, "Failed to grow work spill-file to %lu bytes: %s\n", size, strerror(errno));
+    }
+    if (spill_map)
+    {
+        map = mremap(spill_map, spill_mapped, size, MREMAP_MAYMOVE);
+    }
+    else
+    {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, spill_fd, 0);
+    }
+    if (map == MAP_FAILED)
+    {
+        errsend_fmt(FATAL, "Failed to map %lu bytes of work spill-file: %s\n", size, strerror(errno));
+    }
+    spill_map = (char *)map;
+    spill_mapped = size;
+}
+
+// The spilled copy of <item> is no longer needed.  Give back its space.
+static void spill_release(work_buf_list *item)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = (item->spill_off + page - 1) & ~(page - 1);
+    size_t end = (item->spill_off + item->nbytes) & ~(page - 1);
+
+    item->spilled = 0;
+    if (--spill_now == 0)
+    {
+        start = 0;
+        end = spill_end;
+        spill_end = 0;
+    }
+    // pages shared with a neighbor wait until the file is empty
+    if (end > start)
+    {
+        fallocate(spill_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, start, end - start);
+    }
+}
+
+// Move <item> out of memory, if the queues are over their memory limit.
+static void spill_buf(work_buf_list *item)
+{
+    if (!spill_mem_max || (spill_mem <= spill_mem_max) || item->spilled)
+    {
+        return;
+    }
+    spill_reserve(spill_end + item->nbytes);
+    memcpy(spill_map + spill_end, item->buf, item->nbytes);
+    item->spill_off = spill_end;
+    item->spilled = 1;
+    spill_end += item->nbytes;
+    spill_now++;
+    spill_total++;
+
+    free(item->buf);
+    item->buf = NULL;
+    spill_mem -= item->nbytes;
+}
+
+// After something has been added to a queue, move the newest buffer out of
+// memory, if the manager's queues are over their memory limit.  The head
+// of a queue is the next to go, so it always stays in memory.
+void spill_buf_list_tail(work_buf_list *workbuflist, work_buf_list *workbuftail)
+{
+    if (workbuftail && (workbuftail != workbuflist))
+    {
+        spill_buf(workbuftail);
+    }
+}
+
+// The head of a queue is about to be used.  If it was spilled, read it
+// back, and start reading the next one too.
+static void load_buf_list_head(work_buf_list *head)
 {
+    size_t page;
+    size_t start;
+
+    if (!head->spilled)
+    {
+        return;
+    }
+    head->buf = (char *)malloc(head->nbytes);
+    if (!head->buf)
+    {
+        errsend_fmt(FATAL, "Failed to allocate %d bytes for spilled work\n", head->nbytes);
+    }
+    memcpy(head->buf, spill_map + head->spill_off, head->nbytes);
+    spill_mem += head->nbytes;
+    spill_release(head);
+
+    if (head->next && head->next->spilled)
+    {
+        page = sysconf(_SC_PAGESIZE);
+        start = head->next->spill_off & ~(page - 1);
+        madvise(spill_map + start, head->next->spill_off + head->next->nbytes - start, MADV_WILLNEED);
+    }
+}
 
+// a queue entry for <buffer>, which now belongs to the queue
+static work_buf_list *alloc_buf_item(char *buffer, int buffer_size, int buffer_bytes)
+{
     work_buf_list *new_buf_item = (work_buf_list *)malloc(sizeof(work_buf_list));
-    memset(new_buf_item, 0, sizeof(work_buf_list));
     if (!new_buf_item)
     {
         fprintf(stderr, "Failed to allocate %lu bytes for new_buf_item\n", sizeof(work_buf_list));
         MPI_Abort(MPI_COMM_WORLD, -1);
     }
+    memset(new_buf_item, 0, sizeof(work_buf_list));
     new_buf_item->buf = buffer;
     new_buf_item->size = buffer_size;
+    new_buf_item->nbytes = buffer_bytes;
+    if (MSG_HDR(buffer)->payload_len >= (int)sizeof(path_batch_hdr))
+    {
+        new_buf_item->work_bytes = ((path_batch_hdr *)MSG_PAYLOAD(buffer))->work_bytes;
+    }
     new_buf_item->next = NULL;
+    spill_mem += buffer_bytes;
+    return new_buf_item;
+}
+
+void enqueue_buf_list(work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize, char *buffer, int buffer_size, int buffer_bytes)
+{
+    work_buf_list *new_buf_item = alloc_buf_item(buffer, buffer_size, buffer_bytes);
+
+    if (*workbufsize < 0)
+    {
+        *workbufsize = 0;
+    }
+
+    if (*workbuflist == NULL)
+    {
+        *workbuflist = new_buf_item;
+        *workbuftail = new_buf_item;
+        *workbufsize = 1;
+        return;
+    }
+
+    (*workbuftail)->next = new_buf_item;
+    *workbuftail = new_buf_item;
+    (*workbufsize)++;
+}
+
+void dequeue_buf_list(work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize)
+{
+    if (*workbuflist == NULL)
+        return;
+
+    if (*workbuftail == *workbuflist)
+        *workbuftail = NULL;
+
+    work_buf_list *new_head = (*workbuflist)->next;
+    if ((*workbuflist)->spilled)
+    {
+        spill_release(*workbuflist);
+    }
+    else
+    {
+        spill_mem -= (*workbuflist)->nbytes;
+    }
+    free((*workbuflist)->buf);
+    free(*workbuflist);
+
+    *workbuflist = new_head;
+    (*workbufsize)--;
+}
+
+// Move <item> (already counted in some <workbufsize>) to the end of a list.
+void append_buf_item(work_buf_list *item, work_buf_list **workbuflist, work_buf_list **workbuftail)
+{
+    item->next = NULL;
+    if (*workbuflist == NULL)
+    {
+        *workbuflist = item;
+    }
+    else
+    {
+        (*workbuftail)->next = item;
+    }
+    *workbuftail = item;
+}
+
+// does <a> go before <b>, in a work_buf_heap?
+static int buf_heap_before(const work_buf_list *a, const work_buf_list *b)
+{
+    if (a->work_bytes != b->work_bytes)
+    {
+        return (a->work_bytes > b->work_bytes);
+    }
+    return (a->seq < b->seq);
+}
+
+// Queue <buffer> in <heap>.  <workbufsize> counts it, along with whatever
+// else the caller is counting (e.g. a list that take_buf_heap_top() feeds).
+void enqueue_buf_heap(work_buf_heap *heap, int *workbufsize, char *buffer, int buffer_size, int buffer_bytes)
+{
+    work_buf_list *item = alloc_buf_item(buffer, buffer_size, buffer_bytes);
+    work_buf_list **items;
+    int i;
+    int parent;
+
+    if (heap->count == heap->capacity)
+    {
+        heap->capacity = (heap->capacity ? (heap->capacity * 2) : 1024);
+        items = (work_buf_list **)realloc(heap->items, heap->capacity * sizeof(work_buf_list *));
+        if (!items)
+        {
+            fprintf(stderr, "Failed to allocate %lu bytes for work_buf_heap\n", heap->capacity * sizeof(work_buf_list *));
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        heap->items = items;
+    }
+    item->seq = heap->seq++;
+
+    // sift up
+    for (i = heap->count; i > 0; i = parent)
+    {
+        parent = (i - 1) / 2;
+        if (!buf_heap_before(item, heap->items[parent]))
+        {
+            break;
+        }
+        heap->items[i] = heap->items[parent];
+    }
+    heap->items[i] = item;
+    heap->count++;
+    (*workbufsize)++;
+
+    if (i != 0)
+    {
+        spill_buf(item); // the top is next to go
+    }
+}
 
-    if (*workbufsize < 0)
+// Move the largest buffer in <heap> to the end of <workbuflist>.  The
+// caller's count doesn't change.
+void take_buf_heap_top(work_buf_heap *heap, work_buf_list **workbuflist, work_buf_list **workbuftail)
+{
+    work_buf_list *top;
+    work_buf_list *last;
+    int i;
+    int child;
+
+    if (!heap->count)
     {
-        *workbufsize = 0;
+        return;
     }
+    top = heap->items[0];
+    last = heap->items[--heap->count];
 
-    if (*workbuflist == NULL)
+    // sift down
+    for (i = 0; (child = 2 * i + 1) < heap->count; i = child)
     {
-        *workbuflist = new_buf_item;
-        *workbuftail = new_buf_item;
-        *workbufsize = 1;
-        return;
+        if ((child + 1 < heap->count) && buf_heap_before(heap->items[child + 1], heap->items[child]))
+        {
+            child++;
+        }
+        if (!buf_heap_before(heap->items[child], last))
+        {
+            break;
+        }
+        heap->items[i] = heap->items[child];
+    }
+    if (heap->count)
+    {
+        heap->items[i] = last;
     }
 
-    (*workbuftail)->next = new_buf_item;
-    *workbuftail = new_buf_item;
-    (*workbufsize)++;
+    top->next = NULL;
+    if (*workbuflist)
+    {
+        (*workbuftail)->next = top;
+    }
+    else
+    {
+        *workbuflist = top;
+    }
+    *workbuftail = top;
 }
 
-void dequeue_buf_list(work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize)
+void delete_buf_heap(work_buf_heap *heap, int *workbufsize)
 {
-    if (*workbuflist == NULL)
-        return;
-
-    if (*workbuftail == *workbuflist)
-        *workbuftail = NULL;
-
-    work_buf_list *new_head = (*workbuflist)->next;
-    free((*workbuflist)->buf);
-    free(*workbuflist);
+    work_buf_list *head = NULL;
+    work_buf_list *tail = NULL;
+    int size = 0;
 
-    *workbuflist = new_head;
-    (*workbufsize)--;
+    while (heap->count)
+    {
+        take_buf_heap_top(heap, &head, &tail);
+        size++;
+        dequeue_buf_list(&head, &tail, &size);
+        (*workbufsize)--;
+    }
+    free(heap->items);
+    memset(heap, 0, sizeof(work_buf_heap));
 }
 
 void delete_buf_list(work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize)
@@ -1802,44 +3703,140 @@ void delete_buf_list(work_buf_list **workbuflist, work_buf_list **workbuftail, i
     *workbufsize = 0;
 }
 
-void pack_list(path_list *head, int count, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize)
+// Pack <items> into a new work-buffer message, with the opcode to be filled
+// in by send_buffer_list(), and queue it.
+static work_buf_list *enqueue_path_batch(const path_item *const *items, int count,
+                                         work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize)
 {
-    int position;
-    char *buffer;
-    int buffer_size = 0;
-    int worksize;
-    path_list *iter;
+    int worksize = path_batch_size(items, count);
+    char *msg = (char *)malloc(sizeof(msg_hdr) + worksize);
 
-    worksize = MESSAGEBUFFER * sizeof(path_item);
-    buffer = (char *)calloc(worksize, sizeof(char));
-    if (!buffer)
+    if (!msg)
     {
-        fprintf(stderr, "Failed to allocate %lu bytes for buffer\n", sizeof(worksize));
+        fprintf(stderr, "Failed to allocate %lu bytes for msg\n", sizeof(msg_hdr) + worksize);
         MPI_Abort(MPI_COMM_WORLD, -1);
     }
-    position = 0;
+    pack_path_batch(items, count, MSG_PAYLOAD(msg), worksize);
+    MSG_HDR(msg)->opcode = DIRCMD;
+    MSG_HDR(msg)->count = count;
+    MSG_HDR(msg)->payload_len = worksize;
+    MSG_HDR(msg)->batch_level = 0;
+    enqueue_buf_list(workbuflist, workbuftail, workbufsize, msg, count, sizeof(msg_hdr) + worksize);
+    return *workbuftail;
+}
+
+// Queue the paths in <head>, <per_buffer> to a buffer (at most MESSAGEBUFFER).
+void pack_list(path_list *head, int count, int per_buffer, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize)
+{
+    const path_item *items[MESSAGEBUFFER];
+    int buffer_size = 0;
+    path_list *iter;
 
+    if ((per_buffer < 1) || (per_buffer > MESSAGEBUFFER))
+    {
+        per_buffer = MESSAGEBUFFER;
+    }
     for (iter = head; iter != NULL; iter = iter->next)
     {
-        MPI_Pack(&iter->data, sizeof(path_item), MPI_CHAR, buffer, worksize, &position, MPI_COMM_WORLD);
-        buffer_size++;
-        if (buffer_size % STATBUFFER == 0 || buffer_size % MESSAGEBUFFER == 0)
+        items[buffer_size++] = &iter->data;
+        if ((buffer_size == per_buffer) || (iter->next == NULL))
         {
-            enqueue_buf_list(workbuflist, workbuftail, workbufsize, buffer, buffer_size);
+            enqueue_path_batch(items, buffer_size, workbuflist, workbuftail, workbufsize);
             buffer_size = 0;
-            buffer = (char *)malloc(worksize);
-            if (!buffer)
-            {
-                fprintf(stderr, "Failed to allocate %lu bytes for buffer-elt\n", sizeof(worksize));
-                MPI_Abort(MPI_COMM_WORLD, -1);
-            }
-            position = 0; // should this be here?
         }
     }
-    if (buffer_size != 0)
+}
+
+// The buffer at the head of <workbuflist> is about to be handed to a free
+// rank.  If it holds more than an even share of all the bytes in flight
+// (and more than WORK_SPLIT_MIN_BYTES), split it into pieces of roughly
+// equal bytes, one for each of several free ranks, so that one rank doesn't
+// end up with a huge buffer while the others sit idle.  The pieces replace
+// it at the head of the list, in the same order.
+void split_buf_list_head(worker_pool *pool, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize)
+{
+    work_buf_list *head = *workbuflist;
+    work_buf_list *parts_head = NULL;
+    work_buf_list *parts_tail = NULL;
+    int parts_size = 0;
+    size_t share;
+    size_t remain;
+    int parts;
+    int count;
+    int i;
+    int j;
+
+    if (!head || head->split || (head->size < 2) || (pool->free_count < 2))
+    {
+        return;
+    }
+    load_buf_list_head(head);
+    share = (pool->busy_bytes + head->work_bytes) / pool->nslots;
+    if (share < WORK_SPLIT_MIN_BYTES)
+    {
+        share = WORK_SPLIT_MIN_BYTES;
+    }
+    if (head->work_bytes <= share)
+    {
+        return;
+    }
+    parts = (head->work_bytes + share - 1) / share;
+    if (parts > pool->free_count)
+    {
+        parts = pool->free_count;
+    }
+    if (parts > head->size)
+    {
+        parts = head->size;
+    }
+
+    count = head->size;
+    path_batch_view view;
+    if (path_batch_view_init(&view, MSG_PAYLOAD(head->buf), MSG_HDR(head->buf)->payload_len) != count)
+    {
+        errsend_fmt(FATAL, "split_buf_list_head: expected %d items in buffer\n", count);
+    }
+    path_item *items = (path_item *)malloc(count * sizeof(path_item));
+    const path_item **ptrs = (const path_item **)malloc(count * sizeof(path_item *));
+    if (!items || !ptrs)
+    {
+        errsend_fmt(FATAL, "Failed to allocate %lu bytes for split_buf_list_head\n", count * (sizeof(path_item) + sizeof(path_item *)));
+    }
+    for (i = 0; i < count; i++)
+    {
+        unpack_path_item(&items[i], &view, i);
+        ptrs[i] = &items[i];
+    }
+
+    // consecutive runs of items, each about 1/parts of what's left
+    remain = head->work_bytes;
+    for (i = 0; parts > 0; parts--)
+    {
+        size_t target = remain / parts;
+        size_t bytes = 0;
+        for (j = i; (j < count - (parts - 1)) && ((j == i) || (bytes < target) || (parts == 1)); j++)
+        {
+            bytes += path_item_work_bytes(&items[j]);
+        }
+        enqueue_path_batch(ptrs + i, j - i, &parts_head, &parts_tail, &parts_size)->split = 1;
+        remain -= bytes;
+        i = j;
+    }
+    PRINT_MPI_DEBUG("split_buf_list_head: %d items, %lu bytes -> %d buffers\n", count, head->work_bytes, parts_size);
+    free(items);
+    free(ptrs);
+
+    // swap the pieces in for the original
+    parts_tail->next = head->next;
+    if (*workbuftail == head)
     {
-        enqueue_buf_list(workbuflist, workbuftail, workbufsize, buffer, buffer_size);
+        *workbuftail = parts_tail;
     }
+    *workbuflist = parts_head;
+    *workbufsize += parts_size - 1;
+    spill_mem -= head->nbytes;
+    free(head->buf);
+    free(head);
 }
 
 /**
@@ -1894,6 +3891,410 @@ int samefile(PathPtr p_src, PathPtr p_dst, const struct options &o, int dst_has_
     return 0;
 }
 
+// With '-I' (on an incremental '-n' copy), a source file whose stat is
+// unchanged since an earlier run found it already copied can skip the
+// destination lookup (and samefile()) entirely.  Each worker writes the
+// files it found in sync to its own shard, "snapshot.<rank>" in the '-I'
+// directory, sorted when the rank finishes.  At the start of the next run
+// the manager merges the shards into one sorted file, "snapshot.index",
+// which the workers map read-only, so ranks on a node share one copy in
+// the page cache.  Files copied on this run are recorded on the next one,
+// once samefile() has seen the result.
+//
+// Directory mtimes only cover the names in a directory, not the contents
+// of the files, so the index is consulted per file: the source is still
+// walked and stat'ed.  Changes made directly to the destination, outside
+// pftool, are not noticed.
+typedef struct snapshot_rec
+{
+    uint64_t key; // snapshot_key() of source and destination paths
+    uint64_t size;
+    uint64_t ino;
+    int64_t mtime;
+    int64_t ctime;
+    uint32_t mode;
+    uint32_t unused;
+} snapshot_rec;
+
+static const snapshot_rec *snapshot = NULL; // mapped index, sorted by key
+static size_t snapshot_count = 0;
+static FILE *snapshot_shard = NULL;         // this rank's new shard
+
+// FNV-1a of "<src>\0<dest>", so the same source copied elsewhere misses
+static uint64_t snapshot_key(const char *src, const char *dest)
+{
+    uint64_t key = 14695981039346656037ULL;
+    const char *c;
+
+    for (c = src; *c; c++)
+    {
+        key = (key ^ (unsigned char)*c) * 1099511628211ULL;
+    }
+    key *= 1099511628211ULL;
+    for (c = dest; *c; c++)
+    {
+        key = (key ^ (unsigned char)*c) * 1099511628211ULL;
+    }
+    return key;
+}
+
+static int snapshot_compare(const void *a, const void *b)
+{
+    uint64_t ka = ((const snapshot_rec *)a)->key;
+    uint64_t kb = ((const snapshot_rec *)b)->key;
+
+    return (ka < kb) ? -1 : (ka > kb);
+}
+
+static void snapshot_fill(snapshot_rec *rec, const path_item *src, const char *out_path)
+{
+    memset(rec, 0, sizeof(snapshot_rec));
+    rec->key = snapshot_key(src->path, out_path);
+    rec->size = src->st.st_size;
+    rec->ino = src->st.st_ino;
+    rec->mtime = src->st.st_mtime;
+    rec->ctime = src->st.st_ctime;
+    rec->mode = src->st.st_mode;
+}
+
+// one input of merge_snapshot_files(), with its next record
+typedef struct snapshot_cursor
+{
+    FILE *fp;
+    snapshot_rec rec;
+} snapshot_cursor;
+
+// restore the min-heap (by key) below <heap>[<i>]
+static void snapshot_sift(snapshot_cursor **heap, int count, int i)
+{
+    while (1)
+    {
+        int least = i;
+        int left = (2 * i) + 1;
+        int right = left + 1;
+        snapshot_cursor *tmp;
+
+        if ((left < count) && (heap[left]->rec.key < heap[least]->rec.key))
+        {
+            least = left;
+        }
+        if ((right < count) && (heap[right]->rec.key < heap[least]->rec.key))
+        {
+            least = right;
+        }
+        if (least == i)
+        {
+            return;
+        }
+        tmp = heap[i];
+        heap[i] = heap[least];
+        heap[least] = tmp;
+        i = least;
+    }
+}
+
+// Merge the sorted files <in_paths>[0 .. <count>-1] into <out_path>,
+// dropping exact duplicates.  Only the next record of each input is held
+// in memory.  Returns 0, or -1 with errno set.
+static int merge_snapshot_files(char (*in_paths)[PATHSIZE_PLUS], int count, const char *out_path)
+{
+    snapshot_cursor *cursors = (snapshot_cursor *)calloc(count, sizeof(snapshot_cursor));
+    snapshot_cursor **heap = (snapshot_cursor **)calloc(count, sizeof(snapshot_cursor *));
+    snapshot_rec last;
+    int have_last = 0;
+    int heap_count = 0;
+    int rc = 0;
+    int i;
+    FILE *out;
+
+    if (!cursors || !heap)
+    {
+        errsend_fmt(FATAL, "Failed to allocate %lu bytes to merge the snapshot index\n",
+                    count * (sizeof(snapshot_cursor) + sizeof(snapshot_cursor *)));
+    }
+    if (!(out = fopen(out_path, "w")))
+    {
+        free(cursors);
+        free(heap);
+        return -1;
+    }
+    for (i = 0; i < count; i++)
+    {
+        if (!(cursors[i].fp = fopen(in_paths[i], "r")))
+        {
+            rc = -1;
+            break;
+        }
+        if (fread(&cursors[i].rec, sizeof(snapshot_rec), 1, cursors[i].fp) == 1)
+        {
+            heap[heap_count++] = &cursors[i];
+        }
+    }
+    for (i = (heap_count / 2) - 1; i >= 0; i--)
+    {
+        snapshot_sift(heap, heap_count, i);
+    }
+    while (!rc && heap_count)
+    {
+        snapshot_cursor *next = heap[0];
+
+        if (!have_last || memcmp(&last, &next->rec, sizeof(snapshot_rec)))
+        {
+            if (fwrite(&next->rec, sizeof(snapshot_rec), 1, out) != 1)
+            {
+                rc = -1;
+            }
+            last = next->rec;
+            have_last = 1;
+        }
+        if (fread(&next->rec, sizeof(snapshot_rec), 1, next->fp) != 1)
+        {
+            heap[0] = heap[--heap_count];
+        }
+        snapshot_sift(heap, heap_count, 0);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (cursors[i].fp)
+        {
+            fclose(cursors[i].fp);
+        }
+    }
+    free(cursors);
+    free(heap);
+    if (fclose(out))
+    {
+        rc = -1;
+    }
+    return rc;
+}
+
+// Collective.  The manager merges the shards in <dir> (written by the last
+// run) into a new "snapshot.index", and removes them.  If there are none
+// (e.g. the last run died), the old index stays.  Then each worker maps
+// the index, and opens its new shard.
+void load_snapshot_index(const char *dir, int rank)
+{
+    char shard_path[PATHSIZE_PLUS];
+    char index_path[PATHSIZE_PLUS];
+    struct stat st;
+    int fd;
+
+    if (rank == MANAGER_PROC)
+    {
+        char (*shards)[PATHSIZE_PLUS] = NULL;
+        int count = 0;
+        int alloc = 0;
+        int merges = 0;
+        int merged = 0;
+        int i;
+        DIR *dirp;
+        struct dirent *d;
+
+        if (mkdir(dir, 0755) && (errno != EEXIST))
+        {
+            errsend_fmt(FATAL, "Failed to create snapshot directory '%s': %s\n", dir, strerror(errno));
+        }
+        if (!(dirp = opendir(dir)))
+        {
+            errsend_fmt(FATAL, "Failed to open snapshot directory '%s': %s\n", dir, strerror(errno));
+        }
+        while ((d = readdir(dirp)))
+        {
+            int shard_rank;
+            int len = 0;
+
+            if ((sscanf(d->d_name, "snapshot.%d%n", &shard_rank, &len) != 1) || d->d_name[len])
+            {
+                continue; // not a shard ("snapshot.<rank>.new" is an unfinished one)
+            }
+            if (count == alloc)
+            {
+                alloc = (alloc ? (alloc * 2) : 64);
+                shards = (char(*)[PATHSIZE_PLUS])realloc(shards, alloc * sizeof(*shards));
+                if (!shards)
+                {
+                    errsend_fmt(FATAL, "Failed to allocate %lu bytes for snapshot shard names\n",
+                                alloc * sizeof(*shards));
+                }
+            }
+            snprintf(shards[count++], PATHSIZE_PLUS, "%s/%s", dir, d->d_name);
+        }
+        closedir(dirp);
+
+        // with more shards than we'd want open at once, merge in passes
+        while (count > SNAPSHOT_MERGE_MAX)
+        {
+            int groups = 0;
+
+            for (i = 0; i < count; i += SNAPSHOT_MERGE_MAX)
+            {
+                int n = (((count - i) < SNAPSHOT_MERGE_MAX) ? (count - i) : SNAPSHOT_MERGE_MAX);
+                int j;
+
+                snprintf(shard_path, PATHSIZE_PLUS, "%s/snapshot.merge.%d", dir, merges++);
+                if (merge_snapshot_files(shards + i, n, shard_path))
+                {
+                    errsend_fmt(FATAL, "Failed to merge snapshot shards into '%s': %s\n", shard_path, strerror(errno));
+                }
+                for (j = 0; j < n; j++)
+                {
+                    unlink(shards[i + j]);
+                }
+                strncpy(shards[groups++], shard_path, PATHSIZE_PLUS);
+            }
+            count = groups;
+        }
+
+        snprintf(index_path, PATHSIZE_PLUS, "%s/snapshot.index", dir);
+        snprintf(shard_path, PATHSIZE_PLUS, "%s/snapshot.index.new", dir);
+        if (count && (merge_snapshot_files(shards, count, shard_path) || rename(shard_path, index_path)))
+        {
+            errsend_fmt(NONFATAL, "Failed to merge snapshot shards into '%s': %s\n", index_path, strerror(errno));
+        }
+        else
+        {
+            merged = count;
+        }
+        for (i = 0; i < merged; i++)
+        {
+            unlink(shards[i]);
+        }
+        free(shards);
+    }
+
+    // workers map the index only once the manager has written it
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (rank < START_PROC)
+    {
+        return; // only workers look things up
+    }
+
+    snprintf(index_path, PATHSIZE_PLUS, "%s/snapshot.index", dir);
+    if ((fd = open(index_path, O_RDONLY)) >= 0)
+    {
+        if (!fstat(fd, &st) && (st.st_size >= (off_t)sizeof(snapshot_rec)))
+        {
+            void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (map == MAP_FAILED)
+            {
+                errsend_fmt(NONFATAL, "Failed to map snapshot index '%s': %s\n", index_path, strerror(errno));
+            }
+            else
+            {
+                snapshot = (const snapshot_rec *)map;
+                snapshot_count = st.st_size / sizeof(snapshot_rec);
+            }
+        }
+        close(fd);
+    }
+
+    snprintf(shard_path, PATHSIZE_PLUS, "%s/snapshot.%d.new", dir, rank);
+    if (!(snapshot_shard = fopen(shard_path, "w")))
+    {
+        errsend_fmt(FATAL, "Failed to open snapshot shard '%s': %s\n", shard_path, strerror(errno));
+    }
+}
+
+// sort the records of the shard at <path> in place
+static int sort_snapshot_shard(const char *path)
+{
+    struct stat st;
+    int fd = open(path, O_RDWR);
+    int rc = 0;
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (fstat(fd, &st))
+    {
+        rc = -1;
+    }
+    else if (st.st_size)
+    {
+        void *map = mmap(NULL, st.st_size, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            rc = -1;
+        }
+        else
+        {
+            qsort(map, st.st_size / sizeof(snapshot_rec), sizeof(snapshot_rec), snapshot_compare);
+            rc = munmap(map, st.st_size);
+        }
+    }
+    if (close(fd))
+    {
+        rc = -1;
+    }
+    return rc;
+}
+
+// Finish this rank's new shard (sorted, for the next run's merge), and
+// put it in place.
+void close_snapshot_index(const char *dir, int rank)
+{
+    char new_path[PATHSIZE_PLUS];
+    char shard_path[PATHSIZE_PLUS];
+
+    if (snapshot)
+    {
+        munmap((void *)snapshot, snapshot_count * sizeof(snapshot_rec));
+        snapshot = NULL;
+        snapshot_count = 0;
+    }
+    if (!snapshot_shard)
+    {
+        return;
+    }
+    snprintf(new_path, PATHSIZE_PLUS, "%s/snapshot.%d.new", dir, rank);
+    snprintf(shard_path, PATHSIZE_PLUS, "%s/snapshot.%d", dir, rank);
+    if (fclose(snapshot_shard) || sort_snapshot_shard(new_path) || rename(new_path, shard_path))
+    {
+        errsend_fmt(NONFATAL, "Failed to write snapshot shard '%s': %s\n", shard_path, strerror(errno));
+    }
+    snapshot_shard = NULL;
+}
+
+// <src> was found to be in sync with <out_path>
+void snapshot_record(const path_item *src, const char *out_path)
+{
+    snapshot_rec rec;
+
+    if (!snapshot_shard)
+    {
+        return;
+    }
+    snapshot_fill(&rec, src, out_path);
+    fwrite(&rec, sizeof(rec), 1, snapshot_shard);
+}
+
+// Is <src> unchanged since it was last found in sync with its destination?
+// If so, it's recorded again, for the next run.  Fills in <out_node>'s
+// path, either way.
+int snapshot_unchanged(const path_item *src, path_item *out_node, const char *base_path,
+                       const path_item *dest_node, struct options &o)
+{
+    snapshot_rec rec;
+    const snapshot_rec *found;
+
+    get_output_path(out_node, base_path, src, dest_node, o, 0);
+    if (!snapshot_count)
+    {
+        return 0;
+    }
+    snapshot_fill(&rec, src, out_node->path);
+    found = (const snapshot_rec *)bsearch(&rec, snapshot, snapshot_count, sizeof(snapshot_rec), snapshot_compare);
+    if (!found || memcmp(found, &rec, sizeof(snapshot_rec)))
+    {
+        return 0;
+    }
+    snapshot_record(src, out_node->path);
+    return 1;
+}
+
 // stolen from MarFS epoch_to_str(), for convenience
 #define fka_MARFS_DATE_FORMAT "%Y%m%d_%H%M%S%z"
 #define fka_MARFS_DST_FORMAT "_%d"
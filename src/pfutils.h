@@ -23,6 +23,8 @@
 #include <stdarg.h> // va_list, vsnprintf()
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h> // offsetof()
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -64,18 +66,50 @@ typedef void *SyndataBufPtr; /* eliminates some need for #ifdefs */
 #define MAX_TEMP_UNLINK_ITER 3
 #define TEMP_UNLINK_WAIT_TIME 1
 
+// The batch sizes are tuned while the job runs (see batch_limit()).  These
+// are the largest they can get, and size the arrays that collect them.
+//
 // if you are trying to increase max pack size, STATBUFFER must be >= to
 // COPYBUFFER because it only collects one stat buffer worth of things before
 // shipping off.
-#define DIRBUFFER 5
+#define DIRBUFFER 64
 #define STATBUFFER 4096
 #define COPYBUFFER 4096
 #define CHUNKBUFFER COPYBUFFER
 
+// Once a rank has read this many entries from one directory, it stops
+// stat'ing them itself, and sends the rest of the names out as DIRCMD
+// work, SPLITDIR_BATCH at a time, for other ranks to stat.  Those items
+// are marked with start == START_SPLIT.  (See worker_readdir())
+#define SPLITDIR_ENTRIES STATBUFFER
+#define SPLITDIR_BATCH 1024
+#define START_SPLIT 2
+
+// worker_readdir() stats the names it reads in batches of this many, which
+// run concurrently on the worker threads, with '-y'.
+#define STAT_PIPELINE 256
+
+// worker_readdir() reads directory entries a buffer of this size at a time
+// (see Path::readdir_batch())
+#define DIRENT_BUFSIZE (256 * 1024)
+
+// load_snapshot_index() merges at most this many snapshot shards at once
+#define SNAPSHOT_MERGE_MAX 256
+
 // The amount of data to accumulate before shipping off to a copy process
 //   NON-PARALLEL DESTINATIONS ONLY
 #define SHIPOFF 1073741824
 
+// The manager moves the batch level up or down by one step, at most every
+// BATCH_ADJUST_SECS: down while ranks sit idle with little queued for them
+// (the start and the tail of a job), up while there's more queued than all
+// the ranks could take (steady state).  Workers get the level along with
+// their work.  A batch that has been filling for BATCH_FLUSH_SECS (slow
+// stats) is sent off, whatever its size.  (See update_batch_level())
+#define BATCH_LEVELS 6
+#define BATCH_ADJUST_SECS 0.5
+#define BATCH_FLUSH_SECS 1.0
+
 // The number of stat processes to default to, -1 is infinate
 #define MAXREADDIRRANKS (-1)
 
@@ -84,6 +118,60 @@ typedef void *SyndataBufPtr; /* eliminates some need for #ifdefs */
 // work at this threshold
 #define MAXWORKACCUM 1000000
 
+// By default, the manager keeps up to this many bytes of queued work in
+// memory.  Beyond that, newly queued buffers are spilled to a file in the
+// scratch directory ('-T', default $TMPDIR or /tmp), and read back when they
+// reach the head of their queue.  With '-m 0', nothing is spilled, and the
+// manager stops taking new work beyond MAXWORKACCUM buffers, instead.  The
+// spill file grows WORK_SPILL_GROW bytes at a time.  (See spill_buf_list_tail())
+#define WORK_SPILL_MEM_DEFAULT (1024ULL * 1024 * 1024)
+#define WORK_SPILL_GROW (64ULL * 1024 * 1024)
+#define WORK_SPILL_TEMPLATE "pftool.spill.XXXXXX" // for mkstemp(), in the scratch directory
+
+// Max number of non-blocking sends a rank may have in flight.  Beyond this,
+// senders wait for the oldest ones to drain.  (See send_message_async())
+#define SEND_POOL_SIZE 64
+
+// Sleep limits (usec) between polls, for WAIT_BACKOFF.  Each idle poll
+// doubles the sleep, up to the max.  Any message resets it to the min.
+#define WAIT_BACKOFF_MIN 1
+#define WAIT_BACKOFF_MAX 1000
+
+// Output lines are batched per-rank into one BUFFEROUTCMD to OUTPUT_PROC, sent
+// when this many bytes are buffered, or when the oldest buffered line is
+// this many seconds old.  (See write_output())
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+#define OUTPUT_FLUSH_SECS 0.25
+
+// With '-y', each worker rank runs the items of a copy/compare buffer on
+// this many threads, at most.  (See run_worker_threads())
+#define WORKER_THREADS_MAX 256
+
+// A queued copy/compare buffer holding more than its share of the bytes in
+// flight, and more than this many bytes, is split across the free ranks when
+// it is handed out.  (See split_buf_list_head())
+#define WORK_SPLIT_MIN_BYTES (64ULL * 1024 * 1024)
+
+// With work-stealing, a worker whose steal attempt comes back empty waits
+// this long (usec) before trying another peer, doubling up to the max.
+#define STEAL_BACKOFF_MIN 100
+#define STEAL_BACKOFF_MAX 10000
+
+// With sub-managers ('-H'), a node needs at least this many workers besides
+// the sub-manager itself, to get one.  A sub-manager sends the manager its
+// accumulated copy/examined stats at least this often (secs).
+#define SUBMGR_MIN_WORKERS 2
+#define SUBMGR_REPORT_SECS 0.5
+
+// With '-N local', the rest of a chunked file goes to the node that got its
+// first chunk.  A chunk waits at most this long (secs) for a free rank there.
+#define PLACE_WAIT_SECS 1.0
+
+// Watermarks (queued copy/compare buffers) for the "ratio" dispatch policy.
+// (See plan_dispatch())
+#define DISPATCH_RATIO_LOW 32
+#define DISPATCH_RATIO_HIGH 256
+
 // tag for anything sending *more work* that can increase manager memory pressure
 #define MPI_TAG_MORE_WORK 65535
 
@@ -183,9 +271,6 @@ enum cmd_opcode
     EXITCMD,
     UPDCHUNKCMD,
     BUFFEROUTCMD,
-    OUTCMD,
-    LOGCMD,
-    LOGONLYCMD,
     COMPARECMD,
     COPYCMD,
     PROCESSCMD,
@@ -196,6 +281,8 @@ enum cmd_opcode
     CHUNKBUSYCMD,
     COPYSTATSCMD,
     EXAMINEDSTATSCMD,
+    STEALCMD,
+    NOWORKCMD,
 };
 typedef enum cmd_opcode OpCode;
 
@@ -212,7 +299,7 @@ enum Lethality
     FATAL = 1
 };
 
-// for write_output (unused)
+// for write_output
 // TBD: would be nicer to have OUT=1, SYS=2, BOTH=3
 enum OutputMode
 {
@@ -221,6 +308,14 @@ enum OutputMode
     LOG_SYS = 2
 };
 
+// how idle ranks wait for their next message (see wait_for_message())
+enum WaitMode
+{
+    WAIT_SPIN = 0, // poll continuously
+    WAIT_BACKOFF,  // poll, sleeping exponentially longer while idle
+    WAIT_BLOCK     // block in MPI_Probe(), when there's nothing else to do
+};
+
 enum WorkType
 {
     COPYWORK = 0,
@@ -280,6 +375,19 @@ struct options
     char jid[128];
 
     int max_readdir_ranks;
+    int wait_mode; // WaitMode
+    int work_stealing; // workers keep their own work, and steal from each other
+    char log_dir[PATHSIZE_PLUS]; // if set, workers write output to per-rank shards here
+    int sub_managers; // one rank per node feeds the other workers on that node
+    size_t spill_mem; // queued work the manager keeps in memory (0: no limit)
+    int dispatch;      // DispatchPolicy
+    int dispatch_low;  // watermarks for DISPATCH_RATIO
+    int dispatch_high;
+    int placement;     // ChunkPlacement
+    char spill_dir[PATHSIZE_PLUS]; // where the manager spills the rest
+    int worker_threads; // threads per worker rank, for copy/compare items
+    int dest_listing;   // list destination directories, instead of a stat per file
+    char snapshot_dir[PATHSIZE_PLUS]; // if set, index of files found in sync by '-n' (see load_snapshot_index())
 
 #if GEN_SYNDATA
     char syn_pattern[128];           // a file holding a pattern to be used when generating synthetic data
@@ -294,14 +402,100 @@ struct options
 
 struct worker_proc_status
 {
-    char inuse;
+    int inuse; // buffers handed out, and not yet reported done
     char readdir;
 };
 
+// kinds of work the manager hands out (see worker_pool)
+enum WorkerSet
+{
+    READDIR_SET = 0,
+    COPY_SET, // copy or compare
+    NUM_WORKER_SETS
+};
+
+// The manager's record of which ranks are busy.  Free ranks >= START_PROC
+// are kept as bits, in one bitmap per WorkerSet (a rank is only in the sets
+// it is capable of), so get_free_rank() is a find-first-set starting from
+// the lowest word that might be non-zero.  Ranks below START_PROC (i.e.
+// ACCUM_PROC) are only counted, for processing_complete().
+//
+// A pool only holds the ranks its owner feeds.  With sub-managers, the
+// manager's pool holds each sub-manager (as one rank with a slot for every
+// worker it feeds) instead of that node's workers, and each sub-manager
+// has a pool of its own.  A rank stays free until all its slots are in use.
+typedef struct worker_pool
+{
+    int nproc;
+    int nwords;
+    int *slots;                         // buffers each rank can take at once (0: not ours)
+    int nslots;                         // sum of <slots>
+    uint64_t *capable[NUM_WORKER_SETS]; // ranks that may get this kind of work
+    uint64_t *free[NUM_WORKER_SETS];    // ... and aren't busy
+    int hint[NUM_WORKER_SETS];          // free[] words below this are all zero
+    struct worker_proc_status *status;  // indexed by rank
+    size_t *outstanding;                // bytes handed to each rank, until WORKDONE
+    size_t busy_bytes;                  // sum of <outstanding>
+    long pending_bufs;                  // with work-stealing, buffers not yet finished
+    int free_count;                     // free slots, on ranks >= START_PROC
+    int busy_helpers;                   // busy ranks < START_PROC
+    int readdir_count;                  // ranks doing readdir
+    const int *nodes;                   // node each rank is on (see assign_nodes())
+    int *node_busy;                     // slots in use on each node, indexed by node
+    int *node_slots;                    // ... and the slots it has
+} worker_pool;
+
+// How the manager chooses between handing out directories (readdir) and
+// copy/compare work.  (See plan_dispatch())
+enum DispatchPolicy
+{
+    DISPATCH_DEFAULT = 0, // a few copies, then one readdir, per pass
+    DISPATCH_DISCOVERY,   // directories first: walk the tree breadth-first
+    DISPATCH_THROUGHPUT,  // copy/compare first, to every free rank
+    DISPATCH_RATIO,       // vary the readdir ranks, to keep the copy queue between watermarks
+    NUM_DISPATCH_POLICIES
+};
+
+// Which free rank the manager gives a copy/compare buffer to ('-N').
+// (See get_placed_rank())
+enum ChunkPlacement
+{
+    PLACE_ANY = 0, // the lowest free rank
+    PLACE_SPREAD,  // a free rank on the node with the least work in hand
+    PLACE_LOCAL,   // the chunks of a file all go to one node
+    NUM_PLACEMENTS
+};
+
+// the kinds of batch that batch_limit() knows about
+enum BatchKind
+{
+    BATCH_DIRS,   // directories per DIRCMD (DIRBUFFER)
+    BATCH_STATS,  // stat'ed entries per process_stat_buffer() (STATBUFFER)
+    BATCH_COPIES, // files or chunks per COPYCMD/COMPARECMD (COPYBUFFER)
+    BATCH_BYTES   // bytes per COPYCMD, non-parallel destinations (SHIPOFF)
+};
+
+// what the manager hands out, on one pass through its loop
+typedef struct dispatch_plan
+{
+    int readdir_first; // directories before copy/compare work
+    int process_max;   // copy/compare buffers to hand out (-1: as many as possible)
+    int readdir_max;   // directory buffers to hand out (-1: as many as possible)
+    int readdir_ranks; // ranks that may be doing readdir at once (-1: no limit)
+} dispatch_plan;
+
+typedef struct dispatch_policy
+{
+    int policy;        // DispatchPolicy
+    int low;           // DISPATCH_RATIO watermarks
+    int high;
+    int readdir_ranks; // DISPATCH_RATIO's current limit
+} dispatch_policy;
+
 // the basic object used by pftool internals
 typedef struct path_item
 {
-    int start; // tells us if this path item was created by the inital list provided by the user
+    int start; // tells us if this path item was created by the inital list provided by the user (or START_SPLIT)
     FileType ftype;
     FileType dest_ftype;
     FSType fstype; // the file system type of the source file
@@ -311,6 +505,7 @@ typedef struct path_item
     // tranfer length or file length
     off_t chksz;
     int chkidx; // the chunk index or number of the chunk being processed
+    int chkcnt; // chunks of the file queued for copy/compare (see get_placed_rank())
     int packable;
     int temp_flag;
 
@@ -319,6 +514,122 @@ typedef struct path_item
     char timestamp[DATE_STRING_MAX];
 } path_item;
 
+// Every message between ranks is a single MPI message: this header,
+// followed by <payload_len> bytes of payload.  <count> is the number of items
+// in the payload (e.g. path_items in a packed batch, or output lines), for
+// commands where that means something.  The header is a multiple of 8 bytes,
+// so a payload that starts in a malloc'ed message is 8-byte aligned.
+//
+// See send_message() and recv_message().
+typedef struct msg_hdr
+{
+    int32_t opcode; // OpCode
+    int32_t count;
+    int32_t payload_len;
+    int32_t batch_level; // work from a manager: its batch level, plus one (else 0)
+} msg_hdr;
+
+#define MSG_HDR(msg) ((msg_hdr *)(msg))
+#define MSG_PAYLOAD(msg) ((char *)(msg) + sizeof(msg_hdr))
+
+// payload of COPYSTATSCMD
+typedef struct copy_stats_msg
+{
+    int64_t num_files;
+    int64_t num_bytes;
+} copy_stats_msg;
+
+// payload of EXAMINEDSTATSCMD
+typedef struct examined_stats_msg
+{
+    int64_t num_files;
+    int64_t num_bytes;
+    int64_t num_dirs;
+    int64_t num_finished_bytes;
+} examined_stats_msg;
+
+// payload of WORKDONECMD, with work-stealing
+typedef struct workdone_msg
+{
+    int64_t created; // buffers queued locally, while doing this one
+} workdone_msg;
+
+// payload of BUFFEROUTCMD is <count> of these, each followed by <len> bytes of
+// text (including the NUL).  Records are packed back-to-back, with no
+// alignment, so read the header with memcpy().
+typedef struct output_rec
+{
+    uint32_t len;
+    uint32_t log; // OutputMode
+} output_rec;
+
+// Compact on-the-wire form of a batch of path_items, used for every MPI
+// message that carries work.  A whole path_item is over 4 KB, almost all of
+// it unused path[] / timestamp[] space, so we only ship the fields of <st>
+// that pftool looks at, plus the used part of the two strings.
+//
+// Items in a batch mostly come from one directory, so the directory part
+// that all the paths share is stored once.  A packed batch looks like:
+//
+//    path_batch_hdr
+//    path_item_wire   [count]
+//    string table     [strtab_len]   (prefix, then leaf-names / timestamps)
+//
+// Record <i> has path = prefix + strtab[name_off .. name_off+name_len).
+// Strings are not NUL-terminated.  Records are fixed-size and 8-byte aligned,
+// so they can be read in place, and the full path only needs to be rebuilt
+// by whoever actually uses it.  Runs of identical timestamps share one copy.
+//
+// See pack_path_batch(), path_batch_view_init() and unpack_path_item().
+typedef struct path_batch_hdr
+{
+    uint32_t count;      // number of path_item_wire records
+    uint32_t prefix_len; // shared leading part of every path, at strtab[0]
+    uint32_t strtab_off; // offset of the string table from start of batch
+    uint32_t strtab_len;
+    uint64_t work_bytes; // data to be copied/compared, over all records
+} path_batch_hdr;
+
+typedef struct path_item_wire
+{
+    int64_t size;   // st.st_size
+    int64_t blocks; // st.st_blocks
+    uint64_t ino;   // st.st_ino
+    int64_t chksz;
+    int64_t atime_sec;
+    int64_t atime_nsec;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t ctime_sec;
+    int64_t ctime_nsec;
+    uint32_t mode; // st.st_mode
+    uint32_t uid;  // st.st_uid
+    uint32_t gid;  // st.st_gid
+    int32_t chkidx;
+    int32_t chkcnt;
+    uint32_t name_off; // path, minus the batch prefix
+    uint32_t ts_off;
+    uint16_t name_len;
+    uint16_t ts_len;
+    int8_t start;
+    int8_t ftype;
+    int8_t dest_ftype;
+    int8_t fstype;
+    int8_t packable;
+    int8_t temp_flag;
+} path_item_wire;
+
+// Read-only access to a received batch, without unpacking it.  Records can
+// be read directly through <rec>; see path_batch_view_init().
+typedef struct path_batch_view
+{
+    const path_batch_hdr *hdr;
+    const path_item_wire *rec; // [hdr->count]
+    const char *strtab;
+} path_batch_view;
+
+#define WIRE_ALIGN(n) (((n) + 7) & ~((size_t)7))
+
 // A queue to store all of our input nodes
 typedef struct path_list
 {
@@ -328,11 +639,40 @@ typedef struct path_list
 
 typedef struct work_buf_list
 {
-    char *buf;
-    int size;
+    char *buf;  // a whole message: msg_hdr + packed batch
+    int size;   // number of packed path_items in <buf>
+    int nbytes; // length of <buf>, including the msg_hdr
+    size_t work_bytes; // from the batch header
+    int split;  // a piece of a split buffer; don't split it again
+    int spilled; // <buf> is in the spill file, at <spill_off>
+    size_t spill_off;
+    size_t seq; // order queued, among equals in a work_buf_heap
     struct work_buf_list *next;
 } work_buf_list;
 
+// The manager's copy/compare work, largest (work_bytes) first, so the big
+// files are started early and don't stretch out the end of the run (LPT).
+// Ties go in the order they were queued.
+typedef struct work_buf_heap
+{
+    work_buf_list **items;
+    int count;
+    int capacity;
+    size_t seq;
+} work_buf_heap;
+
+// per-rank state for wait_for_message(), including accumulated idle time
+typedef struct wait_state
+{
+    int mode;           // WaitMode
+    useconds_t backoff; // current sleep, for WAIT_BACKOFF
+    double idle_wall;   // seconds spent waiting for messages
+    double idle_cpu;    // CPU-seconds burned while waiting
+    int idle;           // currently waiting, since idle_wall0/idle_cpu0
+    double idle_wall0;
+    double idle_cpu0;
+} wait_state;
+
 //Function Declarations
 void usage();
 char *printmode(mode_t aflag, char *buf);
@@ -357,9 +697,27 @@ int compare_file(path_item *src_file, path_item *dest_file, size_t blocksize, in
 //local functions
 int request_response(int type_cmd);
 void send_command(int target_rank, int type_cmd, int mpi_tag);
+void send_message(int target_rank, int type_cmd, int count, const void *payload, int payload_len, int mpi_tag);
+void send_message_async(int target_rank, char *msg, int mpi_tag);
+void start_worker_threads(int count);
+void stop_worker_threads();
+void run_worker_threads(int count, void (*fn)(void *arg, int index), void *arg);
+int progress_sends();
+void drain_sends();
+void wait_init(wait_state *ws, int mode);
+int wait_for_message(wait_state *ws, int can_block, MPI_Status *status);
+void report_idle(wait_state *ws, int rank);
+char *recv_message(int source, int mpi_tag, MPI_Status *status);
 void send_path_buffer(int target_rank, int command, path_item *buffer, int *buffer_count);
 void send_buffer_list(int target_rank, int command, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize);
 
+//compact path_item encoding for work buffers
+int path_batch_size(const path_item *const *items, int count);
+int pack_path_batch(const path_item *const *items, int count, char *buf, int bufsize);
+int path_batch_view_init(path_batch_view *view, const char *buf, int bufsize);
+size_t path_batch_path(const path_batch_view *view, int index, char *path);
+void unpack_path_item(path_item *item, const path_batch_view *view, int index);
+
 //worker utility functions
 void errsend(Lethality fatal, const char *error_text);
 void errsend_fmt(Lethality fatal, const char *format, ...);
@@ -367,8 +725,27 @@ void errsend_fmt(Lethality fatal, const char *format, ...);
 //void get_stat_fs_info(path_item *work_node, int *sourcefs, char *sourcefsc);
 int stat_item(path_item *work_node, struct options &o);
 void get_stat_fs_info(const char *path, SrcDstFSType *fs);
-int get_free_rank(struct worker_proc_status *proc_status, int start_range, int end_range);
-int processing_complete(struct worker_proc_status *proc_status, int free_worker_count, int nproc);
+void assign_nodes(int *nodes, int rank, int nproc);
+void assign_sub_managers(int *managers, const int *nodes, int nproc);
+int sub_manager_workers(const int *managers, int nproc, int rank);
+void set_manager_rank(int rank);
+void init_worker_pool(worker_pool *pool, int nproc, const int *managers, const int *nodes, int owner);
+void destroy_worker_pool(worker_pool *pool);
+int get_free_rank(worker_pool *pool, int set);
+int parse_placement(const char *arg);
+const char *placement_name(int placement);
+int get_placed_rank(worker_pool *pool, int set, int placement, work_buf_list *head);
+void set_rank_busy(worker_pool *pool, int rank, int readdir, size_t work_bytes);
+void set_rank_free(worker_pool *pool, int rank);
+int processing_complete(worker_pool *pool);
+int parse_dispatch_policy(const char *arg, int *policy, int *low, int *high);
+const char *dispatch_policy_name(int policy);
+void init_dispatch_policy(dispatch_policy *policy, const worker_pool *pool, int type, int low, int high);
+void plan_dispatch(dispatch_policy *policy, const worker_pool *pool, int process_queued, int dir_queued, int max_readdir_ranks, dispatch_plan *plan);
+void update_batch_level(const worker_pool *pool, int queued);
+void take_batch_level(const char *msg);
+size_t batch_limit(int kind);
+int batch_ready(int kind, int count, double since);
 
 //function definitions for manager
 void send_manager_regs_buffer(path_item *buffer, int *buffer_count);
@@ -381,7 +758,13 @@ void send_manager_work_done(int ignored);
 
 //function definitions for workers
 void write_output(const char *message, int log);
-void write_buffer_output(char *buffer, int buffer_size, int buffer_count);
+void flush_output();
+void open_output_shard(const char *log_dir, const char *jid, int rank);
+void close_output_shard();
+void load_snapshot_index(const char *dir, int rank);
+void close_snapshot_index(const char *dir, int rank);
+void snapshot_record(const path_item *src, const char *out_path);
+int snapshot_unchanged(const path_item *src, path_item *out_node, const char *base_path, const path_item *dest_node, struct options &o);
 void output_fmt(int log, const char *fmt, ...);
 
 void update_chunk(path_item *buffer, int *buffer_count);
@@ -399,12 +782,24 @@ void print_queue_path(path_list *head);
 void delete_queue_path(path_list **head, int *count);
 void enqueue_node(path_list **head, path_list **tail, path_list *new_node, int *count);
 void dequeue_node(path_list **head, path_list **tail, int *count);
-void pack_list(path_list *head, int count, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize);
+void pack_list(path_list *head, int count, int per_buffer, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize);
 
 //function definitions for workbuf_list;
-void enqueue_buf_list(work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize, char *buffer, int buffer_size);
+void enqueue_buf_list(work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize, char *buffer, int buffer_size, int buffer_bytes);
 void dequeue_buf_list(work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize);
+void append_buf_item(work_buf_list *item, work_buf_list **workbuflist, work_buf_list **workbuftail);
+void init_work_spill(const char *dir, size_t mem_max);
+void close_work_spill();
+long work_spill_count();
+void spill_buf_list_tail(work_buf_list *workbuflist, work_buf_list *workbuftail);
+void enqueue_buf_heap(work_buf_heap *heap, int *workbufsize, char *buffer, int buffer_size, int buffer_bytes);
+void take_buf_heap_top(work_buf_heap *heap, work_buf_list **workbuflist, work_buf_list **workbuftail);
+void delete_buf_heap(work_buf_heap *heap, int *workbufsize);
 void delete_buf_list(work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize);
+void init_local_work(int work_type, int recurse);
+char *pop_local_work();
+char *steal_local_work();
+void split_buf_list_head(worker_pool *pool, work_buf_list **workbuflist, work_buf_list **workbuftail, int *workbufsize);
 
 // functions with signatures that involve C++ Path sub-classes, etc
 // (Path subclasses are also used internally by other util-functions.)